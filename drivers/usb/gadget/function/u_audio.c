@@ -23,6 +23,10 @@
 #define PRD_SIZE_MAX	PAGE_SIZE
 #define MIN_PERIODS	4
 
+/* feedback pitch, in parts per million of the nominal rate */
+#define FBACK_PITCH_BASE	1000000
+#define FBACK_PITCH_MAX		2000	/* max. deviation */
+
 struct uac_req {
 	struct uac_rtd_params *pp; /* parent param */
 	struct usb_request *req;
@@ -43,7 +47,10 @@ struct uac_rtd_params {
 	unsigned int max_psize;	/* MaxPacketSize of endpoint */
 	struct uac_req *ureq;
 
-	spinlock_t lock;
+	/* feedback endpoint, capture only */
+	bool fb_ep_enabled;
+	struct usb_request *req_fback;
+	unsigned int pitch;	/* requested rate, FBACK_PITCH_BASE = nominal */
 };
 
 struct snd_uac_chip {
@@ -76,10 +83,51 @@ static const struct snd_pcm_hardware uac_pcm_hardware = {
 	.periods_min = MIN_PERIODS,
 };
 
+/*
+ * Steer the host towards keeping the capture buffer half full: a reader
+ * consuming slower than the host sends lets the buffer fill up, so ask
+ * for proportionally fewer samples, and vice versa.
+ * Called with the stream lock held.
+ */
+static void u_audio_update_pitch(struct uac_rtd_params *prm,
+				 struct snd_pcm_runtime *runtime)
+{
+	snd_pcm_sframes_t target, delta;
+
+	target = runtime->buffer_size / 2;
+	if (!target)
+		return;
+	delta = (snd_pcm_sframes_t)snd_pcm_capture_avail(runtime) - target;
+	delta = delta * FBACK_PITCH_MAX / target;
+	delta = clamp_t(snd_pcm_sframes_t, delta,
+			-FBACK_PITCH_MAX, FBACK_PITCH_MAX);
+	WRITE_ONCE(prm->pitch, FBACK_PITCH_BASE - delta);
+}
+
+/*
+ * Full-speed feedback is in samples per frame as Q10.14 in three bytes,
+ * high-speed in samples per microframe as Q16.16 in four bytes.
+ */
+static void u_audio_set_fback_value(enum usb_device_speed speed,
+				    unsigned int srate, unsigned int pitch,
+				    struct usb_request *req)
+{
+	u64 ff = (u64)srate * pitch;
+
+	if (speed == USB_SPEED_FULL) {
+		ff = DIV_ROUND_CLOSEST_ULL(ff << 14, 1000ULL * FBACK_PITCH_BASE);
+		req->length = 3;
+	} else {
+		ff = DIV_ROUND_CLOSEST_ULL(ff << 13, 1000ULL * FBACK_PITCH_BASE);
+		req->length = 4;
+	}
+	*(__le32 *)req->buf = cpu_to_le32((u32)ff);
+}
+
 static void u_audio_iso_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	unsigned int pending;
-	unsigned long flags, flags2;
+	unsigned long flags;
 	unsigned int hw_ptr;
 	int status = req->status;
 	struct uac_req *ur = req->context;
@@ -111,16 +159,15 @@ static void u_audio_iso_complete(struct usb_ep *ep, struct usb_request *req)
 	if (!substream)
 		goto exit;
 
-	snd_pcm_stream_lock_irqsave(substream, flags2);
+	/* the stream lock covers hw_ptr and the playback residue as well */
+	snd_pcm_stream_lock_irqsave(substream, flags);
 
 	runtime = substream->runtime;
 	if (!runtime || !snd_pcm_running(substream)) {
-		snd_pcm_stream_unlock_irqrestore(substream, flags2);
+		snd_pcm_stream_unlock_irqrestore(substream, flags);
 		goto exit;
 	}
 
-	spin_lock_irqsave(&prm->lock, flags);
-
 	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
 		/*
 		 * For each IN packet, take the quotient of the current data
@@ -147,8 +194,6 @@ static void u_audio_iso_complete(struct usb_ep *ep, struct usb_request *req)
 
 	hw_ptr = prm->hw_ptr;
 
-	spin_unlock_irqrestore(&prm->lock, flags);
-
 	/* Pack USB load in ALSA ring buffer */
 	pending = runtime->dma_bytes - hw_ptr;
 
@@ -172,12 +217,12 @@ static void u_audio_iso_complete(struct usb_ep *ep, struct usb_request *req)
 		}
 	}
 
-	spin_lock_irqsave(&prm->lock, flags);
 	/* update hw_ptr after data is copied to memory */
 	prm->hw_ptr = (hw_ptr + req->actual) % runtime->dma_bytes;
 	hw_ptr = prm->hw_ptr;
-	spin_unlock_irqrestore(&prm->lock, flags);
-	snd_pcm_stream_unlock_irqrestore(substream, flags2);
+	if (prm->fb_ep_enabled)
+		u_audio_update_pitch(prm, runtime);
+	snd_pcm_stream_unlock_irqrestore(substream, flags);
 
 	if ((hw_ptr % snd_pcm_lib_period_bytes(substream)) < req->actual)
 		snd_pcm_period_elapsed(substream);
@@ -187,13 +232,46 @@ static void u_audio_iso_complete(struct usb_ep *ep, struct usb_request *req)
 		dev_err(uac->card->dev, "%d Error!\n", __LINE__);
 }
 
+static void u_audio_iso_fback_complete(struct usb_ep *ep,
+				       struct usb_request *req)
+{
+	struct uac_rtd_params *prm = req->context;
+	struct snd_uac_chip *uac = prm->uac;
+	struct g_audio *audio_dev = uac->audio_dev;
+	int status = req->status;
+
+	/* i/f shutting down */
+	if (!prm->fb_ep_enabled) {
+		kfree(req->buf);
+		usb_ep_free_request(ep, req);
+		return;
+	}
+
+	if (req->status == -ESHUTDOWN)
+		return;
+
+	if (status)
+		pr_debug("%s: iso_complete status(%d) %d/%d\n",
+			__func__, status, req->actual, req->length);
+
+	/* without a reader the nominal rate is as good as any */
+	if (!prm->ss)
+		WRITE_ONCE(prm->pitch, FBACK_PITCH_BASE);
+
+	u_audio_set_fback_value(audio_dev->gadget->speed,
+				audio_dev->params.c_srate,
+				READ_ONCE(prm->pitch), req);
+
+	if (usb_ep_queue(ep, req, GFP_ATOMIC))
+		dev_err(uac->card->dev, "%d Error!\n", __LINE__);
+}
+
 static int uac_pcm_trigger(struct snd_pcm_substream *substream, int cmd)
 {
 	struct snd_uac_chip *uac = snd_pcm_substream_chip(substream);
 	struct uac_rtd_params *prm;
 	struct g_audio *audio_dev;
 	struct uac_params *params;
-	unsigned long flags;
 	int err = 0;
 
 	audio_dev = uac->audio_dev;
@@ -204,8 +282,6 @@ static int uac_pcm_trigger(struct snd_pcm_substream *substream, int cmd)
 	else
 		prm = &uac->c_prm;
 
-	spin_lock_irqsave(&prm->lock, flags);
-
 	/* Reset */
 	prm->hw_ptr = 0;
 
@@ -222,8 +298,6 @@ static int uac_pcm_trigger(struct snd_pcm_substream *substream, int cmd)
 		err = -EINVAL;
 	}
 
-	spin_unlock_irqrestore(&prm->lock, flags);
-
 	/* Clear buffer after Play stops */
 	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK && !prm->ss)
 		memset(prm->rbuf, 0, prm->max_psize * params->req_number);
@@ -267,7 +341,6 @@ static int uac_pcm_open(struct snd_pcm_substream *substream)
 	runtime->hw = uac_pcm_hardware;
 
 	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
-		spin_lock_init(&uac->p_prm.lock);
 		runtime->hw.rate_min = p_srate;
 		switch (p_ssize) {
 		case 3:
@@ -284,7 +357,6 @@ static int uac_pcm_open(struct snd_pcm_substream *substream)
 		runtime->hw.period_bytes_min = 2 * uac->p_prm.max_psize
 						/ runtime->hw.periods_min;
 	} else {
-		spin_lock_init(&uac->c_prm.lock);
 		runtime->hw.rate_min = c_srate;
 		switch (c_ssize) {
 		case 3:
@@ -357,6 +429,68 @@ static inline void free_ep(struct uac_rtd_params *prm, struct usb_ep *ep)
 		dev_err(uac->card->dev, "%s:%d Error!\n", __func__, __LINE__);
 }
 
+static inline void free_ep_fback(struct uac_rtd_params *prm, struct usb_ep *ep)
+{
+	struct snd_uac_chip *uac = prm->uac;
+
+	if (!prm->fb_ep_enabled)
+		return;
+
+	prm->fb_ep_enabled = false;
+
+	if (prm->req_fback) {
+		if (usb_ep_dequeue(ep, prm->req_fback)) {
+			kfree(prm->req_fback->buf);
+			usb_ep_free_request(ep, prm->req_fback);
+		}
+		/*
+		 * If usb_ep_dequeue() cannot successfully dequeue the
+		 * request, the request will be freed by the completion
+		 * callback.
+		 */
+		prm->req_fback = NULL;
+	}
+
+	if (usb_ep_disable(ep))
+		dev_err(uac->card->dev, "%s:%d Error!\n", __func__, __LINE__);
+}
+
+static int u_audio_start_fback(struct g_audio *audio_dev,
+			       struct uac_rtd_params *prm)
+{
+	struct usb_gadget *gadget = audio_dev->gadget;
+	struct usb_ep *ep = audio_dev->in_ep_fback;
+	struct usb_request *req;
+
+	config_ep_by_speed(gadget, &audio_dev->func, ep);
+
+	prm->pitch = FBACK_PITCH_BASE;
+	prm->fb_ep_enabled = true;
+	usb_ep_enable(ep);
+
+	req = usb_ep_alloc_request(ep, GFP_ATOMIC);
+	if (req == NULL)
+		return -ENOMEM;
+
+	req->buf = kzalloc(4, GFP_ATOMIC);
+	if (!req->buf) {
+		usb_ep_free_request(ep, req);
+		return -ENOMEM;
+	}
+
+	prm->req_fback = req;
+	req->zero = 0;
+	req->context = prm;
+	req->complete = u_audio_iso_fback_complete;
+	u_audio_set_fback_value(gadget->speed, audio_dev->params.c_srate,
+				prm->pitch, req);
+
+	if (usb_ep_queue(ep, req, GFP_ATOMIC))
+		dev_err(&gadget->dev, "%s:%d Error!\n", __func__, __LINE__);
+
+	return 0;
+}
+
 
 int u_audio_start_capture(struct g_audio *audio_dev)
 {
@@ -397,6 +531,9 @@ int u_audio_start_capture(struct g_audio *audio_dev)
 			dev_err(dev, "%s:%d Error!\n", __func__, __LINE__);
 	}
 
+	if (audio_dev->in_ep_fback)
+		return u_audio_start_fback(audio_dev, prm);
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(u_audio_start_capture);
@@ -405,6 +542,8 @@ void u_audio_stop_capture(struct g_audio *audio_dev)
 {
 	struct snd_uac_chip *uac = audio_dev->uac;
 
+	if (audio_dev->in_ep_fback)
+		free_ep_fback(&uac->c_prm, audio_dev->in_ep_fback);
 	free_ep(&uac->c_prm, audio_dev->out_ep);
 }
 EXPORT_SYMBOL_GPL(u_audio_stop_capture);
@@ -37,6 +37,7 @@ struct snd_compr_ops;
  * @dma_addr: physical buffer address (not accessible from main CPU)
  * @dma_bytes: size of DMA area
  * @dma_buffer_p: runtime dma buffer pointer
+ * @status: stream status record, mmappable by user space
  */
 struct snd_compr_runtime {
 	snd_pcm_state_t state;
@@ -54,6 +55,8 @@ struct snd_compr_runtime {
 	dma_addr_t dma_addr;
 	size_t dma_bytes;
 	struct snd_dma_buffer *dma_buffer_p;
+
+	struct snd_compr_mmap_status *status;
 };
 
 /**
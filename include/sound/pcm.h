@@ -16,6 +16,7 @@
 #include <linux/bitops.h>
 #include <linux/pm_qos.h>
 #include <linux/refcount.h>
+#include <linux/hrtimer.h>
 
 #define snd_pcm_substream_chip(substream) ((substream)->private_data)
 #define snd_pcm_chip(pcm) ((pcm)->private_data)
@@ -49,6 +50,8 @@ struct snd_pcm_substream;
 
 struct snd_pcm_audio_tstamp_config; /* definitions further down */
 struct snd_pcm_audio_tstamp_report;
+struct snd_pcm_hist;
+struct snd_pcm_mix;
 
 struct snd_pcm_ops {
 	int (*open)(struct snd_pcm_substream *substream);
@@ -243,6 +246,7 @@ struct snd_pcm_hw_constraints {
 	unsigned int rules_num;
 	unsigned int rules_all;
 	struct snd_pcm_hw_rule *rules;
+	unsigned int serial;		/* bumped on each change */
 };
 
 static inline struct snd_mask *constrs_mask(struct snd_pcm_hw_constraints *constrs,
@@ -341,6 +345,8 @@ static inline void snd_pcm_pack_audio_tstamp_report(__u32 *data, __u32 *accuracy
 }
 
 
+struct snd_pcm_hw_refine_cache;
+
 struct snd_pcm_runtime {
 	/* -- Status -- */
 	struct snd_pcm_substream *trigger_master;
@@ -372,6 +378,7 @@ struct snd_pcm_runtime {
 	unsigned int rate_num;
 	unsigned int rate_den;
 	unsigned int no_period_wakeup: 1;
+	unsigned int tsched: 1;		/* timer-based wakeup */
 
 	/* -- SW params -- */
 	int tstamp_mode;		/* mmap timestamp is updated */
@@ -407,6 +414,11 @@ struct snd_pcm_runtime {
 	struct snd_pcm_hardware hw;
 	struct snd_pcm_hw_constraints hw_constraints;
 
+	/* -- hw_refine cache -- */
+	struct snd_pcm_hw_refine_cache *refine_cache;
+	unsigned int refine_calls;	/* snd_pcm_hw_refine() calls */
+	unsigned int refine_hits;	/* ... served from the cache */
+
 	/* -- timer -- */
 	unsigned int timer_resolution;	/* timer resolution */
 	int tstamp_type;		/* timestamp type */
@@ -457,6 +469,7 @@ struct snd_pcm_substream {
         /* -- timer section -- */
 	struct snd_timer *timer;		/* timer */
 	unsigned timer_running: 1;	/* time is running */
+	struct hrtimer tsched_timer;	/* wakeup timer in tsched mode */
 	long wait_time;	/* time in ms for R/W to wait for avail */
 	/* -- next substream -- */
 	struct snd_pcm_substream *next;
@@ -476,7 +489,15 @@ struct snd_pcm_substream {
 #endif
 #ifdef CONFIG_SND_VERBOSE_PROCFS
 	struct snd_info_entry *proc_root;
+	/* -- timing histograms, see pcm_local.h -- */
+	struct snd_pcm_hist __percpu *hist;
+	u64 hist_period_ns;		/* last period interrupt */
+	u64 hist_irq_ns;		/* oldest period interrupt not waited for */
+	u64 hist_wake_ns;		/* wakeup not followed by appl_ptr yet */
 #endif /* CONFIG_SND_VERBOSE_PROCFS */
+#ifdef CONFIG_SND_PCM_MIX
+	struct snd_pcm_mix *mix;	/* mixer fed by this substream */
+#endif
 	/* misc flags */
 	unsigned int hw_opened: 1;
 	unsigned int managed_buffer_alloc:1;
@@ -523,6 +544,7 @@ struct snd_pcm {
 	bool internal; /* pcm is for internal use only */
 	bool nonatomic; /* whole PCM operations are in non-atomic context */
 	bool no_device_suspend; /* don't invoke device PM suspend */
+	bool hw_refine_cache; /* cache hw_refine; rules use no untracked state */
 #if IS_ENABLED(CONFIG_SND_PCM_OSS)
 	struct snd_pcm_oss oss;
 #endif
@@ -1071,6 +1093,10 @@ snd_pcm_sframes_t __snd_pcm_lib_xfer(struct snd_pcm_substream *substream,
 				     void *buf, bool interleaved,
 				     snd_pcm_uframes_t frames, bool in_kernel);
 
+snd_pcm_sframes_t snd_pcm_lib_write_iov(struct snd_pcm_substream *substream,
+					const struct snd_xferi_iov *iov,
+					unsigned long nr_segs);
+
 static inline snd_pcm_sframes_t
 snd_pcm_lib_write(struct snd_pcm_substream *substream,
 		  const void __user *buf, snd_pcm_uframes_t frames)
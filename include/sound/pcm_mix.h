@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ *  Mixing of several playback substreams into one hardware substream
+ */
+
+#ifndef __SOUND_PCM_MIX_H
+#define __SOUND_PCM_MIX_H
+
+#include <sound/pcm.h>
+
+/* fixed setup of the hardware substream, which the voices inherit */
+struct snd_pcm_mix_config {
+	snd_pcm_format_t format;	/* SNDRV_PCM_FORMAT_S16_LE or S32_LE */
+	unsigned int rate;
+	unsigned int channels;
+	snd_pcm_uframes_t period_size;	/* in frames, also for the voices */
+	unsigned int periods;		/* of the hardware buffer, at least 2 */
+};
+
+int snd_pcm_mix_new(struct snd_card *card, const char *id, int device,
+		    int voices, const struct snd_pcm_mix_config *config,
+		    struct snd_pcm **rpcm, struct snd_pcm **rhw_pcm);
+
+#endif /* __SOUND_PCM_MIX_H */
@@ -15,7 +15,8 @@ struct snd_pcm_oss_setup {
 		     nonblock:1,
 		     partialfrag:1,
 		     nosilence:1,
-		     buggyptr:1;
+		     buggyptr:1,
+		     hqrate:1;
 	unsigned int periods;
 	unsigned int period_size;
 	struct snd_pcm_oss_setup *next;
@@ -61,7 +61,11 @@ struct snd_rawmidi_runtime {
 	size_t avail_min;	/* min avail for wakeup */
 	size_t avail;		/* max used buffer for wakeup */
 	size_t xruns;		/* over/underruns counter */
+	size_t align;		/* read granularity - 1 (input only) */
 	int buffer_ref;		/* buffer reference count */
+	/* input framing, SNDRV_RAWMIDI_MODE_XXX */
+	unsigned int framing;
+	unsigned int clock_type;
 	/* misc */
 	spinlock_t lock;
 	wait_queue_head_t sleep;
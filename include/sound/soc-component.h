@@ -167,6 +167,15 @@ struct snd_soc_component_driver {
 	unsigned int use_pmdown_time:1; /* care pmdown_time at stop */
 	unsigned int endianness:1;
 	unsigned int non_legacy_dai_naming:1;
+	/*
+	 * DAPM may write adjacent registers of one power sequence step with
+	 * a single auto-incrementing regmap transfer.  The registers are read
+	 * when a step is gathered and written back when it ends, without a
+	 * lock held in between, so only set this if no register holding a
+	 * DAPM widget's power bits has any field written outside of DAPM,
+	 * e.g. by a plain volume or switch kcontrol.
+	 */
+	unsigned int dapm_burst_write:1;
 
 	/* this component uses topology and ignore machine driver FEs */
 	const char *ignore_machine;
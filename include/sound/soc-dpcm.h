@@ -85,6 +85,16 @@ struct snd_soc_dpcm {
 #endif
 };
 
+/* FE hardware limits before and after merging the BEs in */
+struct snd_soc_dpcm_hw {
+	u64 formats;
+	unsigned int rates;
+	unsigned int rate_min;
+	unsigned int rate_max;
+	unsigned int channels_min;
+	unsigned int channels_max;
+};
+
 /*
  * Dynamic PCM runtime data.
  */
@@ -101,6 +111,19 @@ struct snd_soc_dpcm_runtime {
 	enum snd_soc_dpcm_state state;
 
 	int trigger_pending; /* trigger cmd + 1 if pending, 0 if not */
+
+	/*
+	 * FE only: result of the last DAPM walk and BE merge, reused while
+	 * card->route_gen still matches the generation they were made at.
+	 */
+	unsigned int route_gen;
+	struct snd_soc_dapm_widget_list *path_cache;
+	int path_cache_paths;
+	unsigned int path_cache_gen;
+	struct snd_soc_dpcm_hw hw_cache_in;
+	struct snd_soc_dpcm_hw hw_cache_out;
+	unsigned int hw_cache_gen;
+	bool hw_cache_valid;
 };
 
 #define for_each_dpcm_fe(be, stream, _dpcm)				\
@@ -146,6 +169,7 @@ static inline void soc_dpcm_debugfs_add(struct snd_soc_pcm_runtime *rtd)
 int dpcm_path_get(struct snd_soc_pcm_runtime *fe,
 	int stream, struct snd_soc_dapm_widget_list **list_);
 void dpcm_path_put(struct snd_soc_dapm_widget_list **list);
+void dpcm_path_cache_free(struct snd_soc_pcm_runtime *fe);
 int dpcm_process_paths(struct snd_soc_pcm_runtime *fe,
 	int stream, struct snd_soc_dapm_widget_list **list, int new);
 int dpcm_be_dai_startup(struct snd_soc_pcm_runtime *fe, int stream);
@@ -986,6 +986,9 @@ struct snd_soc_card {
 	struct mutex mutex;
 	struct mutex dapm_mutex;
 
+	/* bumped on routing or DAI caps changes, see dpcm_path_get() */
+	atomic_t route_gen;
+
 	/* Mutex for PCM operations */
 	struct mutex pcm_mutex;
 	enum snd_soc_pcm_subclass pcm_subclass;
@@ -13,6 +13,7 @@
 
 struct snd_soc_jack;
 struct snd_soc_card;
+struct snd_soc_dapm_context;
 struct snd_soc_dapm_widget;
 struct snd_soc_dapm_path;
 
@@ -153,6 +154,33 @@ TRACE_EVENT(snd_soc_dapm_walk_done,
 		  (int)__entry->path_checks, (int)__entry->neighbour_checks)
 );
 
+TRACE_EVENT(snd_soc_dapm_burst,
+
+	TP_PROTO(struct snd_soc_dapm_context *dapm, int updates, int writes,
+		 int transfers),
+
+	TP_ARGS(dapm, updates, writes, transfers),
+
+	TP_STRUCT__entry(
+		__string(	name,	dapm->component->name	)
+		__field(	int,	updates			)
+		__field(	int,	writes			)
+		__field(	int,	transfers		)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dapm->component->name);
+		__entry->updates = updates;
+		__entry->writes = writes;
+		__entry->transfers = transfers;
+	),
+
+	TP_printk("%s: %d updates, %d writes in %d transfers, %d saved",
+		  __get_str(name), (int)__entry->updates,
+		  (int)__entry->writes, (int)__entry->transfers,
+		  (int)(__entry->updates - __entry->transfers))
+);
+
 TRACE_EVENT(snd_soc_dapm_path,
 
 	TP_PROTO(struct snd_soc_dapm_widget *widget,
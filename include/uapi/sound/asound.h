@@ -156,7 +156,7 @@ struct snd_hwdep_dsp_image {
  *                                                                           *
  *****************************************************************************/
 
-#define SNDRV_PCM_VERSION		SNDRV_PROTOCOL_VERSION(2, 0, 15)
+#define SNDRV_PCM_VERSION		SNDRV_PROTOCOL_VERSION(2, 0, 17)
 
 typedef unsigned long snd_pcm_uframes_t;
 typedef signed long snd_pcm_sframes_t;
@@ -391,6 +391,7 @@ typedef int snd_pcm_hw_param_t;
 #define SNDRV_PCM_HW_PARAMS_NORESAMPLE	(1<<0)	/* avoid rate resampling */
 #define SNDRV_PCM_HW_PARAMS_EXPORT_BUFFER	(1<<1)	/* export buffer */
 #define SNDRV_PCM_HW_PARAMS_NO_PERIOD_WAKEUP	(1<<2)	/* disable period wakeups */
+#define SNDRV_PCM_HW_PARAMS_TIMER_WAKEUP	(1<<3)	/* wake up by kernel timer */
 
 struct snd_interval {
 	unsigned int min, max;
@@ -610,6 +611,20 @@ struct snd_xfern {
 	snd_pcm_uframes_t frames;
 };
 
+/* one segment of an interleaved vector transfer */
+struct snd_xferi_iov {
+	void __user *buf;
+	snd_pcm_uframes_t frames;
+};
+
+#define SNDRV_PCM_XFERIV_MAX_SEGS	1024
+
+struct snd_xferiv {
+	snd_pcm_sframes_t result;
+	struct snd_xferi_iov __user *iov;
+	snd_pcm_uframes_t nr_segs;	/* up to SNDRV_PCM_XFERIV_MAX_SEGS */
+};
+
 enum {
 	SNDRV_PCM_TSTAMP_TYPE_GETTIMEOFDAY = 0,	/* gettimeofday equivalent */
 	SNDRV_PCM_TSTAMP_TYPE_MONOTONIC,	/* posix_clock_monotonic equivalent */
@@ -697,6 +712,7 @@ enum {
 #define SNDRV_PCM_IOCTL_READI_FRAMES	_IOR('A', 0x51, struct snd_xferi)
 #define SNDRV_PCM_IOCTL_WRITEN_FRAMES	_IOW('A', 0x52, struct snd_xfern)
 #define SNDRV_PCM_IOCTL_READN_FRAMES	_IOR('A', 0x53, struct snd_xfern)
+#define SNDRV_PCM_IOCTL_WRITEIV_FRAMES	_IOW('A', 0x54, struct snd_xferiv)
 #define SNDRV_PCM_IOCTL_LINK		_IOW('A', 0x60, int)
 #define SNDRV_PCM_IOCTL_UNLINK		_IO('A', 0x61)
 
@@ -710,7 +726,7 @@ enum {
  *  Raw MIDI section - /dev/snd/midi??
  */
 
-#define SNDRV_RAWMIDI_VERSION		SNDRV_PROTOCOL_VERSION(2, 0, 1)
+#define SNDRV_RAWMIDI_VERSION		SNDRV_PROTOCOL_VERSION(2, 0, 2)
 
 enum {
 	SNDRV_RAWMIDI_STREAM_OUTPUT = 0,
@@ -736,12 +752,40 @@ struct snd_rawmidi_info {
 	unsigned char reserved[64];	/* reserved for future use */
 };
 
+#define SNDRV_RAWMIDI_MODE_FRAMING_MASK		(7<<0)
+#define SNDRV_RAWMIDI_MODE_FRAMING_SHIFT	0
+#define SNDRV_RAWMIDI_MODE_FRAMING_NONE		(0<<0)
+#define SNDRV_RAWMIDI_MODE_FRAMING_TSTAMP	(1<<0)
+#define SNDRV_RAWMIDI_MODE_CLOCK_MASK		(7<<3)
+#define SNDRV_RAWMIDI_MODE_CLOCK_SHIFT		3
+#define SNDRV_RAWMIDI_MODE_CLOCK_NONE		(0<<3)
+#define SNDRV_RAWMIDI_MODE_CLOCK_REALTIME	(1<<3)
+#define SNDRV_RAWMIDI_MODE_CLOCK_MONOTONIC	(2<<3)
+#define SNDRV_RAWMIDI_MODE_CLOCK_MONOTONIC_RAW	(3<<3)
+
 struct snd_rawmidi_params {
 	int stream;
 	size_t buffer_size;		/* queue size in bytes */
 	size_t avail_min;		/* minimum avail bytes for wakeup */
 	unsigned int no_active_sensing: 1; /* do not send active sensing byte in close() */
-	unsigned char reserved[16];	/* reserved for future use */
+	unsigned int mode;		/* input only: SNDRV_RAWMIDI_MODE_XXX */
+	unsigned char reserved[12];	/* reserved for future use */
+};
+
+#define SNDRV_RAWMIDI_FRAMING_DATA_LENGTH	16
+
+/*
+ * Input record in SNDRV_RAWMIDI_MODE_FRAMING_TSTAMP mode.  Every chunk
+ * received from the device is stored in one or more frames carrying the
+ * time of arrival; read() returns whole frames only.
+ */
+struct snd_rawmidi_framing_tstamp {
+	__u8 frame_type;	/* always 0 for now, skip unknown types */
+	__u8 length;		/* number of valid bytes in data */
+	__u8 reserved[2];
+	__u32 tv_nsec;		/* nanoseconds */
+	__u64 tv_sec;		/* seconds */
+	__u8 data[SNDRV_RAWMIDI_FRAMING_DATA_LENGTH];
 };
 
 #ifndef __KERNEL__
@@ -766,7 +810,7 @@ struct snd_rawmidi_status {
  *  Timer section - /dev/snd/timer
  */
 
-#define SNDRV_TIMER_VERSION		SNDRV_PROTOCOL_VERSION(2, 0, 7)
+#define SNDRV_TIMER_VERSION		SNDRV_PROTOCOL_VERSION(2, 0, 8)
 
 enum {
 	SNDRV_TIMER_CLASS_NONE = -1,
@@ -871,6 +915,34 @@ struct snd_timer_status {
 };
 #endif
 
+/*
+ * mmap ring of timer events
+ *
+ * With SNDRV_TIMER_IOCTL_RING (after TREAD64, before SELECT), the events are
+ * no longer queued for read() but stored into a ring that user space maps
+ * at offset 0.  The ring starts with struct snd_timer_ring_header, followed
+ * at SNDRV_TIMER_RING_HEADER_SIZE by @size records in the 64-bit time
+ * layout of struct snd_timer_tread.  The kernel advances @head after a
+ * record is written (release), the application advances @tail after it has
+ * consumed one (release); both indices are free running, use them modulo
+ * @size.  Optionally an eventfd is signalled on every new record.
+ */
+struct snd_timer_ring_params {
+	unsigned int size;		/* records, power of two (32-65536) */
+	int eventfd;			/* eventfd to signal, or -1 */
+	unsigned char reserved[56];	/* reserved */
+};
+
+struct snd_timer_ring_header {
+	__u32 head;			/* RO: write index */
+	__u32 tail;			/* RW: read index */
+	__u32 size;			/* RO: number of records */
+	__u32 overrun;			/* RO: records lost because of a full ring */
+	unsigned char reserved[48];	/* reserved */
+};
+
+#define SNDRV_TIMER_RING_HEADER_SIZE	64
+
 #define SNDRV_TIMER_IOCTL_PVERSION	_IOR('T', 0x00, int)
 #define SNDRV_TIMER_IOCTL_NEXT_DEVICE	_IOWR('T', 0x01, struct snd_timer_id)
 #define SNDRV_TIMER_IOCTL_TREAD_OLD	_IOW('T', 0x02, int)
@@ -887,6 +959,7 @@ struct snd_timer_status {
 #define SNDRV_TIMER_IOCTL_CONTINUE	_IO('T', 0xa2)
 #define SNDRV_TIMER_IOCTL_PAUSE		_IO('T', 0xa3)
 #define SNDRV_TIMER_IOCTL_TREAD64	_IOW('T', 0xa4, int)
+#define SNDRV_TIMER_IOCTL_RING		_IOW('T', 0xa5, struct snd_timer_ring_params)
 
 #if __BITS_PER_LONG == 64
 #define SNDRV_TIMER_IOCTL_TREAD SNDRV_TIMER_IOCTL_TREAD_OLD
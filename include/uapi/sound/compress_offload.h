@@ -31,7 +31,7 @@
 #include <sound/compress_params.h>
 
 
-#define SNDRV_COMPRESS_VERSION SNDRV_PROTOCOL_VERSION(0, 2, 0)
+#define SNDRV_COMPRESS_VERSION SNDRV_PROTOCOL_VERSION(0, 2, 1)
 /**
  * struct snd_compressed_buffer - compressed buffer
  * @fragment_size: size of buffer fragment in bytes
@@ -83,6 +83,34 @@ struct snd_compr_avail {
 	struct snd_compr_tstamp tstamp;
 } __attribute__((packed, aligned(4)));
 
+/**
+ * struct snd_compr_mmap_status - stream status mapped to user space
+ * @seq: sequence counter, odd while the record is being updated; a reader
+ *	retries when it is odd or has changed after reading the other fields
+ * @state: stream state, SNDRV_PCM_STATE_XXX
+ * @total_bytes_available: bytes committed by the application (playback) or
+ *	made available by the DSP (capture)
+ * @total_bytes_transferred: bytes consumed by the DSP (playback) or by the
+ *	application (capture)
+ * @buffer_size: size of the ring buffer in bytes
+ * @tstamp: last timestamp reported by the DSP
+ *
+ * The record is refreshed whenever the kernel queries the DSP pointer, i.e.
+ * on poll(), on read()/write() and on the ioctls.
+ */
+struct snd_compr_mmap_status {
+	__u32 seq;
+	__s32 state;
+	__u64 total_bytes_available;
+	__u64 total_bytes_transferred;
+	__u64 buffer_size;
+	struct snd_compr_tstamp tstamp;
+} __attribute__((packed, aligned(4)));
+
+/* mmap offsets of the ring buffer and of the status record */
+#define SNDRV_COMPRESS_MMAP_OFFSET_DATA		0x00000000
+#define SNDRV_COMPRESS_MMAP_OFFSET_STATUS	0x80000000
+
 enum snd_compr_direction {
 	SND_COMPRESS_PLAYBACK = 0,
 	SND_COMPRESS_CAPTURE
@@ -154,6 +182,8 @@ struct snd_compr_metadata {
  * SNDRV_COMPRESS_TSTAMP: get the current timestamp value
  * SNDRV_COMPRESS_AVAIL: get the current buffer avail value.
  * This also queries the tstamp properties
+ * SNDRV_COMPRESS_COMMIT: hand over the given number of bytes written to
+ * (playback) or read from (capture) the mmapped ring buffer
  * SNDRV_COMPRESS_PAUSE: Pause the running stream
  * SNDRV_COMPRESS_RESUME: resume a paused stream
  * SNDRV_COMPRESS_START: Start a stream
@@ -174,6 +204,7 @@ struct snd_compr_metadata {
 						 struct snd_compr_metadata)
 #define SNDRV_COMPRESS_TSTAMP		_IOR('C', 0x20, struct snd_compr_tstamp)
 #define SNDRV_COMPRESS_AVAIL		_IOR('C', 0x21, struct snd_compr_avail)
+#define SNDRV_COMPRESS_COMMIT		_IOW('C', 0x22, __u32)
 #define SNDRV_COMPRESS_PAUSE		_IO('C', 0x30)
 #define SNDRV_COMPRESS_RESUME		_IO('C', 0x31)
 #define SNDRV_COMPRESS_START		_IO('C', 0x32)
@@ -181,11 +212,6 @@ struct snd_compr_metadata {
 #define SNDRV_COMPRESS_DRAIN		_IO('C', 0x34)
 #define SNDRV_COMPRESS_NEXT_TRACK	_IO('C', 0x35)
 #define SNDRV_COMPRESS_PARTIAL_DRAIN	_IO('C', 0x36)
-/*
- * TODO
- * 1. add mmap support
- *
- */
 #define SND_COMPR_TRIGGER_DRAIN 7 /*FIXME move this to pcm.h */
 #define SND_COMPR_TRIGGER_NEXT_TRACK 8
 #define SND_COMPR_TRIGGER_PARTIAL_DRAIN 9
@@ -26,6 +26,8 @@
 #include <linux/uaccess.h>
 #include <linux/module.h>
 #include <linux/compat.h>
+#include <linux/vmalloc.h>
+#include <linux/dma-mapping.h>
 #include <sound/core.h>
 #include <sound/initval.h>
 #include <sound/info.h>
@@ -125,6 +127,13 @@ static int snd_compr_open(struct inode *inode, struct file *f)
 		snd_card_unref(compr->card);
 		return -ENOMEM;
 	}
+	runtime->status = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!runtime->status) {
+		kfree(runtime);
+		kfree(data);
+		snd_card_unref(compr->card);
+		return -ENOMEM;
+	}
 	runtime->state = SNDRV_PCM_STATE_OPEN;
 	init_waitqueue_head(&runtime->sleep);
 	data->stream.runtime = runtime;
@@ -133,6 +142,7 @@ static int snd_compr_open(struct inode *inode, struct file *f)
 	ret = compr->ops->open(&data->stream);
 	mutex_unlock(&compr->lock);
 	if (ret) {
+		free_page((unsigned long)runtime->status);
 		kfree(runtime);
 		kfree(data);
 	}
@@ -158,13 +168,36 @@ static int snd_compr_free(struct inode *inode, struct file *f)
 	}
 
 	data->stream.ops->free(&data->stream);
-	if (!data->stream.runtime->dma_buffer_p)
-		kfree(data->stream.runtime->buffer);
+	if (!runtime->dma_buffer_p && runtime->buffer)
+		free_pages_exact(runtime->buffer, runtime->buffer_size);
+	free_page((unsigned long)runtime->status);
 	kfree(data->stream.runtime);
 	kfree(data);
 	return 0;
 }
 
+/*
+ * Refresh the mmapped status record; called with the device lock held.
+ * The sequence counter lets user space detect a torn read.
+ */
+static void snd_compr_update_status(struct snd_compr_stream *stream,
+				    const struct snd_compr_tstamp *tstamp)
+{
+	struct snd_compr_runtime *runtime = stream->runtime;
+	struct snd_compr_mmap_status *status = runtime->status;
+
+	WRITE_ONCE(status->seq, status->seq + 1);
+	smp_wmb();
+	status->state = runtime->state;
+	status->total_bytes_available = runtime->total_bytes_available;
+	status->total_bytes_transferred = runtime->total_bytes_transferred;
+	status->buffer_size = runtime->buffer_size;
+	if (tstamp)
+		status->tstamp = *tstamp;
+	smp_wmb();
+	WRITE_ONCE(status->seq, status->seq + 1);
+}
+
 static int snd_compr_update_tstamp(struct snd_compr_stream *stream,
 		struct snd_compr_tstamp *tstamp)
 {
@@ -177,6 +210,7 @@ static int snd_compr_update_tstamp(struct snd_compr_stream *stream,
 		stream->runtime->total_bytes_transferred = tstamp->copied_total;
 	else
 		stream->runtime->total_bytes_available = tstamp->copied_total;
+	snd_compr_update_status(stream, tstamp);
 	return 0;
 }
 
@@ -324,6 +358,7 @@ static ssize_t snd_compr_write(struct file *f, const char __user *buf,
 		pr_debug("stream prepared, Houston we are good to go\n");
 	}
 
+	snd_compr_update_status(stream, NULL);
 	mutex_unlock(&stream->device->lock);
 	return retval;
 }
@@ -373,17 +408,113 @@ static ssize_t snd_compr_read(struct file *f, char __user *buf,
 	}
 	if (retval > 0)
 		stream->runtime->total_bytes_transferred += retval;
+	snd_compr_update_status(stream, NULL);
 
 out:
 	mutex_unlock(&stream->device->lock);
 	return retval;
 }
 
-static int snd_compr_mmap(struct file *f, struct vm_area_struct *vma)
+/*
+ * mmap the status record, read-only
+ */
+static int snd_compr_mmap_status(struct snd_compr_stream *stream,
+				 struct vm_area_struct *vma)
 {
+	long size = vma->vm_end - vma->vm_start;
+
+	if (size != PAGE_ALIGN(sizeof(struct snd_compr_mmap_status)))
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+	return vm_insert_page(vma, vma->vm_start,
+			      virt_to_page(stream->runtime->status));
+}
+
+/* map vmalloc'ed or SG pages one by one */
+static int snd_compr_mmap_pages(struct vm_area_struct *vma, void *area)
+{
+	unsigned long offset;
+	int err;
+
+	for (offset = 0; offset < vma->vm_end - vma->vm_start;
+	     offset += PAGE_SIZE) {
+		err = vm_insert_page(vma, vma->vm_start + offset,
+				     vmalloc_to_page(area + offset));
+		if (err < 0)
+			return err;
+	}
+	return 0;
+}
+
+/*
+ * mmap the ring buffer; the application then writes or reads the data in
+ * place and hands it over via SNDRV_COMPRESS_COMMIT instead of write/read.
+ */
+static int snd_compr_mmap_data(struct snd_compr_stream *stream,
+			       struct vm_area_struct *vma)
+{
+	struct snd_compr_runtime *runtime = stream->runtime;
+	struct snd_dma_buffer *dmab = runtime->dma_buffer_p;
+	long size = vma->vm_end - vma->vm_start;
+	void *area = runtime->buffer;
+
+	if (runtime->state == SNDRV_PCM_STATE_OPEN)
+		return -EBADFD;
+	if (stream->ops->mmap)
+		return stream->ops->mmap(stream, vma);
+	/* the data lives on the DSP side */
+	if (stream->ops->copy || !area)
+		return -ENXIO;
+	if (size > PAGE_ALIGN(runtime->buffer_size))
+		return -EINVAL;
+
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+	/* buffer allocated by snd_compr_allocate_buffer() */
+	if (!dmab || dmab->dev.type == SNDRV_DMA_TYPE_CONTINUOUS)
+		return remap_pfn_range(vma, vma->vm_start,
+				       virt_to_phys(area) >> PAGE_SHIFT,
+				       size, vma->vm_page_prot);
+	if (IS_ENABLED(CONFIG_HAS_DMA) &&
+	    (dmab->dev.type == SNDRV_DMA_TYPE_DEV ||
+	     dmab->dev.type == SNDRV_DMA_TYPE_DEV_UC))
+		return dma_mmap_coherent(dmab->dev.dev, vma, dmab->area,
+					 dmab->addr, dmab->bytes);
+	if (dmab->dev.type == SNDRV_DMA_TYPE_DEV_SG ||
+	    dmab->dev.type == SNDRV_DMA_TYPE_DEV_UC_SG ||
+	    dmab->dev.type == SNDRV_DMA_TYPE_VMALLOC)
+		return snd_compr_mmap_pages(vma, area);
 	return -ENXIO;
 }
 
+static int snd_compr_mmap(struct file *f, struct vm_area_struct *vma)
+{
+	struct snd_compr_file *data = f->private_data;
+	struct snd_compr_stream *stream;
+	int retval;
+
+	if (snd_BUG_ON(!data))
+		return -EFAULT;
+
+	stream = &data->stream;
+	mutex_lock(&stream->device->lock);
+	switch (vma->vm_pgoff << PAGE_SHIFT) {
+	case SNDRV_COMPRESS_MMAP_OFFSET_STATUS:
+		retval = snd_compr_mmap_status(stream, vma);
+		break;
+	case SNDRV_COMPRESS_MMAP_OFFSET_DATA:
+		retval = snd_compr_mmap_data(stream, vma);
+		break;
+	default:
+		retval = -EINVAL;
+		break;
+	}
+	mutex_unlock(&stream->device->lock);
+	return retval;
+}
+
 static __poll_t snd_compr_get_poll(struct snd_compr_stream *stream)
 {
 	if (stream->direction == SND_COMPRESS_PLAYBACK)
@@ -438,6 +569,7 @@ static __poll_t snd_compr_poll(struct file *f, poll_table *wait)
 		retval = snd_compr_get_poll(stream) | EPOLLERR;
 		break;
 	}
+	snd_compr_update_status(stream, NULL);
 out:
 	mutex_unlock(&stream->device->lock);
 	return retval;
@@ -554,7 +686,9 @@ static int snd_compr_allocate_buffer(struct snd_compr_stream *stream,
 				buffer = stream->runtime->dma_buffer_p->area;
 
 		} else {
-			buffer = kmalloc(buffer_size, GFP_KERNEL);
+			/* whole pages, so that user space may mmap it */
+			buffer = alloc_pages_exact(buffer_size,
+						   GFP_KERNEL | __GFP_ZERO);
 		}
 
 		if (!buffer)
@@ -705,6 +839,56 @@ snd_compr_tstamp(struct snd_compr_stream *stream, unsigned long arg)
 	return ret;
 }
 
+static int
+snd_compr_commit(struct snd_compr_stream *stream, unsigned long arg)
+{
+	struct snd_compr_runtime *runtime = stream->runtime;
+	size_t avail;
+	__u32 bytes;
+	int retval;
+
+	/* no mmappable ring buffer in the core */
+	if (stream->ops->copy)
+		return -ENXIO;
+	if (get_user(bytes, (__u32 __user *)arg))
+		return -EFAULT;
+
+	switch (runtime->state) {
+	case SNDRV_PCM_STATE_SETUP:
+	case SNDRV_PCM_STATE_PREPARED:
+	case SNDRV_PCM_STATE_RUNNING:
+		break;
+	case SNDRV_PCM_STATE_PAUSED:
+	case SNDRV_PCM_STATE_DRAINING:
+		/* same as read, capture data may be consumed after stop */
+		if (stream->direction == SND_COMPRESS_CAPTURE)
+			break;
+		fallthrough;
+	default:
+		return -EBADFD;
+	}
+
+	avail = snd_compr_get_avail(stream);
+	if (bytes > avail)
+		return -EINVAL;
+
+	if (stream->direction == SND_COMPRESS_CAPTURE) {
+		runtime->total_bytes_transferred += bytes;
+		return 0;
+	}
+
+	/* if DSP cares, let it know data has been written */
+	if (stream->ops->ack) {
+		retval = stream->ops->ack(stream, bytes);
+		if (retval < 0)
+			return retval;
+	}
+	runtime->total_bytes_available += bytes;
+	if (runtime->state == SNDRV_PCM_STATE_SETUP)
+		runtime->state = SNDRV_PCM_STATE_PREPARED;
+	return 0;
+}
+
 static int snd_compr_pause(struct snd_compr_stream *stream)
 {
 	int retval;
@@ -980,6 +1164,9 @@ static long snd_compr_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 	case _IOC_NR(SNDRV_COMPRESS_AVAIL):
 		retval = snd_compr_ioctl_avail(stream, arg);
 		break;
+	case _IOC_NR(SNDRV_COMPRESS_COMMIT):
+		retval = snd_compr_commit(stream, arg);
+		break;
 	case _IOC_NR(SNDRV_COMPRESS_PAUSE):
 		retval = snd_compr_pause(stream);
 		break;
@@ -1003,6 +1190,7 @@ static long snd_compr_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 		break;
 
 	}
+	snd_compr_update_status(stream, NULL);
 	mutex_unlock(&stream->device->lock);
 	return retval;
 }
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *  KUnit tests of the control element lookup
+ *
+ *  Adds a growing number of controls to a card and checks and times
+ *  snd_ctl_find_id() and snd_ctl_find_numid() on every one of them, so
+ *  that the lookup cost can be compared against the control count.
+ */
+
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <sound/core.h>
+#include <sound/control.h>
+#include <sound/initval.h>
+
+static const struct snd_kcontrol_new test_ctl = {
+	.iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+	.access = SNDRV_CTL_ELEM_ACCESS_READ,
+	.info = snd_ctl_boolean_mono_info,
+};
+
+static void test_ctl_lookup(struct kunit *test, unsigned int count)
+{
+	struct snd_kcontrol_new tmpl = test_ctl;
+	struct snd_kcontrol **kctls;
+	struct snd_ctl_elem_id id;
+	struct snd_card *card;
+	char name[SNDRV_CTL_ELEM_ID_NAME_MAXLEN];
+	u64 id_ns, numid_ns;
+	unsigned int i;
+	int err;
+
+	kctls = kunit_kzalloc(test, count * sizeof(*kctls), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, kctls);
+	err = snd_card_new(NULL, SNDRV_DEFAULT_IDX1, NULL, THIS_MODULE, 0,
+			   &card);
+	KUNIT_ASSERT_EQ(test, err, 0);
+
+	tmpl.name = name;
+	for (i = 0; i < count; i++) {
+		snprintf(name, sizeof(name), "Test Control %u", i);
+		kctls[i] = snd_ctl_new1(&tmpl, NULL);
+		if (!kctls[i]) {
+			err = -ENOMEM;
+			break;
+		}
+		err = snd_ctl_add(card, kctls[i]);
+		if (err < 0)
+			break;
+	}
+	KUNIT_EXPECT_EQ(test, err, 0);
+	if (err < 0)
+		goto out;
+
+	down_read(&card->controls_rwsem);
+	id_ns = ktime_get_ns();
+	for (i = 0; i < count; i++) {
+		id = kctls[i]->id;
+		id.numid = 0;
+		if (snd_ctl_find_id(card, &id) != kctls[i])
+			err = -ENOENT;
+	}
+	id_ns = ktime_get_ns() - id_ns;
+	numid_ns = ktime_get_ns();
+	for (i = 0; i < count; i++) {
+		if (snd_ctl_find_numid(card, kctls[i]->id.numid) != kctls[i])
+			err = -ENOENT;
+	}
+	numid_ns = ktime_get_ns() - numid_ns;
+	up_read(&card->controls_rwsem);
+	KUNIT_EXPECT_EQ(test, err, 0);
+
+	kunit_info(test, "%u controls: find_id %llu ns, find_numid %llu ns\n",
+		   count, div_u64(id_ns, count), div_u64(numid_ns, count));
+
+ out:
+	snd_card_free(card);
+}
+
+static void test_ctl_lookup_16(struct kunit *test)
+{
+	test_ctl_lookup(test, 16);
+}
+
+static void test_ctl_lookup_256(struct kunit *test)
+{
+	test_ctl_lookup(test, 256);
+}
+
+static void test_ctl_lookup_4096(struct kunit *test)
+{
+	test_ctl_lookup(test, 4096);
+}
+
+static struct kunit_case snd_ctl_test_cases[] = {
+	KUNIT_CASE(test_ctl_lookup_16),
+	KUNIT_CASE(test_ctl_lookup_256),
+	KUNIT_CASE(test_ctl_lookup_4096),
+	{}
+};
+
+static struct kunit_suite snd_ctl_test_suite = {
+	.name = "snd-ctl-lookup",
+	.test_cases = snd_ctl_test_cases,
+};
+
+kunit_test_suite(snd_ctl_test_suite);
+
+MODULE_LICENSE("GPL");
@@ -37,6 +37,11 @@ struct linear_priv {
 	unsigned int dst_bytes;		/* byte size of destination format */
 	unsigned int copy_bytes;	/* bytes to copy per conversion */
 	unsigned int flip; /* MSB flip for signeness, done after endian conv */
+	/* fast path for 16/32bit formats without padding bits */
+	void (*fast_convert)(char *dst, int dst_step,
+			     const char *src, int src_step,
+			     snd_pcm_uframes_t frames, u32 flip);
+	u32 host_flip;	/* MSB flip in host order for the fast path */
 };
 
 static inline void do_convert(struct linear_priv *data,
@@ -52,6 +57,71 @@ static inline void do_convert(struct linear_priv *data,
 	memcpy(dst, p + data->dst_ofs, data->dst_bytes);
 }
 
+/*
+ * Fast path: samples are loaded into a host-order u32 with the MSB aligned
+ * to bit 31, the sign is flipped and the result is stored back in the
+ * destination width and byte order.  One loop is generated for each
+ * combination of width and byte order, so there are no per-sample memcpy()
+ * calls or branches.
+ */
+#define load16(p)	((u32)*(const u16 *)(p) << 16)
+#define load16s(p)	((u32)swab16(*(const u16 *)(p)) << 16)
+#define load32(p)	(*(const u32 *)(p))
+#define load32s(p)	swab32(*(const u32 *)(p))
+#define store16(p, v)	(*(u16 *)(p) = (v) >> 16)
+#define store16s(p, v)	(*(u16 *)(p) = swab16((v) >> 16))
+#define store32(p, v)	(*(u32 *)(p) = (v))
+#define store32s(p, v)	(*(u32 *)(p) = swab32(v))
+
+#define DEFINE_FAST_CONVERT(load, store)				\
+static void fast_##load##_##store(char *dst, int dst_step,		\
+				  const char *src, int src_step,	\
+				  snd_pcm_uframes_t frames, u32 flip)	\
+{									\
+	while (frames-- > 0) {						\
+		u32 v = load(src) ^ flip;				\
+		store(dst, v);						\
+		src += src_step;					\
+		dst += dst_step;					\
+	}								\
+}
+
+DEFINE_FAST_CONVERT(load16, store16)
+DEFINE_FAST_CONVERT(load16, store16s)
+DEFINE_FAST_CONVERT(load16, store32)
+DEFINE_FAST_CONVERT(load16, store32s)
+DEFINE_FAST_CONVERT(load16s, store16)
+DEFINE_FAST_CONVERT(load16s, store16s)
+DEFINE_FAST_CONVERT(load16s, store32)
+DEFINE_FAST_CONVERT(load16s, store32s)
+DEFINE_FAST_CONVERT(load32, store16)
+DEFINE_FAST_CONVERT(load32, store16s)
+DEFINE_FAST_CONVERT(load32, store32)
+DEFINE_FAST_CONVERT(load32, store32s)
+DEFINE_FAST_CONVERT(load32s, store16)
+DEFINE_FAST_CONVERT(load32s, store16s)
+DEFINE_FAST_CONVERT(load32s, store32)
+DEFINE_FAST_CONVERT(load32s, store32s)
+
+/* indexed by [src 32bit][src swapped][dst 32bit][dst swapped] */
+static void (* const fast_converts[2][2][2][2])(char *dst, int dst_step,
+						 const char *src, int src_step,
+						 snd_pcm_uframes_t frames,
+						 u32 flip) = {
+	{
+		{ { fast_load16_store16, fast_load16_store16s },
+		  { fast_load16_store32, fast_load16_store32s } },
+		{ { fast_load16s_store16, fast_load16s_store16s },
+		  { fast_load16s_store32, fast_load16s_store32s } },
+	},
+	{
+		{ { fast_load32_store16, fast_load32_store16s },
+		  { fast_load32_store32, fast_load32_store32s } },
+		{ { fast_load32s_store16, fast_load32s_store16s },
+		  { fast_load32s_store32, fast_load32s_store32s } },
+	},
+};
+
 static void convert(struct snd_pcm_plugin *plugin,
 		    const struct snd_pcm_plugin_channel *src_channels,
 		    struct snd_pcm_plugin_channel *dst_channels,
@@ -76,6 +146,11 @@ static void convert(struct snd_pcm_plugin *plugin,
 		dst = dst_channels[channel].area.addr + dst_channels[channel].area.first / 8;
 		src_step = src_channels[channel].area.step / 8;
 		dst_step = dst_channels[channel].area.step / 8;
+		if (data->fast_convert) {
+			data->fast_convert(dst, dst_step, src, src_step,
+					   frames, data->host_flip);
+			continue;
+		}
 		frames1 = frames;
 		while (frames1-- > 0) {
 			do_convert(data, dst, src);
@@ -113,6 +188,42 @@ static snd_pcm_sframes_t linear_transfer(struct snd_pcm_plugin *plugin,
 	return frames;
 }
 
+/* is the format eligible for the fast path?  returns the byte order
+ * difference to the host via *swapped
+ */
+static bool fast_format(snd_pcm_format_t format, int *swapped)
+{
+	int width = snd_pcm_format_width(format);
+
+	if (width != 16 && width != 32)
+		return false;
+	if (snd_pcm_format_physical_width(format) != width)
+		return false;
+#ifdef SNDRV_LITTLE_ENDIAN
+	*swapped = snd_pcm_format_big_endian(format) > 0;
+#else
+	*swapped = snd_pcm_format_little_endian(format) > 0;
+#endif
+	return true;
+}
+
+static void init_fast_convert(struct linear_priv *data,
+			      snd_pcm_format_t src_format,
+			      snd_pcm_format_t dst_format)
+{
+	int src_swap, dst_swap;
+
+	if (!fast_format(src_format, &src_swap) ||
+	    !fast_format(dst_format, &dst_swap))
+		return;
+	data->fast_convert =
+		fast_converts[snd_pcm_format_width(src_format) == 32][src_swap]
+			     [snd_pcm_format_width(dst_format) == 32][dst_swap];
+	if (snd_pcm_format_signed(src_format) !=
+	    snd_pcm_format_signed(dst_format))
+		data->host_flip = 0x80000000;
+}
+
 static void init_data(struct linear_priv *data,
 		      snd_pcm_format_t src_format, snd_pcm_format_t dst_format)
 {
@@ -144,6 +255,7 @@ static void init_data(struct linear_priv *data,
 		else
 			data->flip = (__force u32)cpu_to_be32(0x80000000);
 	}
+	init_fast_convert(data, src_format, dst_format);
 }
 
 int snd_pcm_plugin_build_linear(struct snd_pcm_substream *plug,
@@ -151,20 +151,10 @@ struct mulaw_priv {
 	unsigned int native_bytes;	/* byte size of the native format */
 	unsigned int copy_bytes;	/* bytes to copy per conversion */
 	u16 flip; /* MSB flip for signedness, done after endian conversion */
+	bool direct16;	/* native format is 16bit; store decoded words as is */
+	u16 decode[256];	/* mu-law -> flipped and byte-swapped s16 */
 };
 
-static inline void cvt_s16_to_native(struct mulaw_priv *data,
-				     unsigned char *dst, u16 sample)
-{
-	sample ^= data->flip;
-	if (data->cvt_endian)
-		sample = swab16(sample);
-	if (data->native_bytes > data->copy_bytes)
-		memset(dst, 0, data->native_bytes);
-	memcpy(dst + data->native_ofs, (char *)&sample + data->copy_ofs,
-	       data->copy_bytes);
-}
-
 static void mulaw_decode(struct snd_pcm_plugin *plugin,
 			const struct snd_pcm_plugin_channel *src_channels,
 			struct snd_pcm_plugin_channel *dst_channels,
@@ -190,9 +180,21 @@ static void mulaw_decode(struct snd_pcm_plugin *plugin,
 		src_step = src_channels[channel].area.step / 8;
 		dst_step = dst_channels[channel].area.step / 8;
 		frames1 = frames;
+		if (data->direct16) {
+			while (frames1-- > 0) {
+				*(u16 *)dst = data->decode[*(unsigned char *)src];
+				src += src_step;
+				dst += dst_step;
+			}
+			continue;
+		}
 		while (frames1-- > 0) {
-			signed short sample = ulaw2linear(*src);
-			cvt_s16_to_native(data, dst, sample);
+			u16 sample = data->decode[*(unsigned char *)src];
+			if (data->native_bytes > data->copy_bytes)
+				memset(dst, 0, data->native_bytes);
+			memcpy(dst + data->native_ofs,
+			       (char *)&sample + data->copy_ofs,
+			       data->copy_bytes);
 			src += src_step;
 			dst += dst_step;
 		}
@@ -295,6 +297,23 @@ static void init_data(struct mulaw_priv *data, snd_pcm_format_t format)
 		data->native_ofs = data->native_bytes -
 			snd_pcm_format_width(format) / 8;
 	}
+	data->direct16 = data->native_bytes == 2 && data->copy_bytes == 2 &&
+		!data->native_ofs;
+}
+
+/* precalculate the decoded words in the native byte order and signedness,
+ * so that decoding is a mere table lookup per sample
+ */
+static void init_decode_table(struct mulaw_priv *data)
+{
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		u16 sample = (u16)ulaw2linear(i) ^ data->flip;
+		if (data->cvt_endian)
+			sample = swab16(sample);
+		data->decode[i] = sample;
+	}
 }
 
 int snd_pcm_plugin_build_mulaw(struct snd_pcm_substream *plug,
@@ -340,6 +359,8 @@ int snd_pcm_plugin_build_mulaw(struct snd_pcm_substream *plug,
 	data = (struct mulaw_priv *)plugin->extra_data;
 	data->func = func;
 	init_data(data, format->format);
+	if (func == mulaw_decode)
+		init_decode_table(data);
 	plugin->transfer = mulaw_transfer;
 	*r_plugin = plugin;
 	return 0;
@@ -2929,7 +2929,7 @@ static void snd_pcm_oss_proc_read(struct snd_info_entry *entry,
 	struct snd_pcm_oss_setup *setup = pstr->oss.setup_list;
 	mutex_lock(&pstr->oss.setup_mutex);
 	while (setup) {
-		snd_iprintf(buffer, "%s %u %u%s%s%s%s%s%s\n",
+		snd_iprintf(buffer, "%s %u %u%s%s%s%s%s%s%s\n",
 			    setup->task_name,
 			    setup->periods,
 			    setup->period_size,
@@ -2938,7 +2938,8 @@ static void snd_pcm_oss_proc_read(struct snd_info_entry *entry,
 			    setup->block ? " block" : "",
 			    setup->nonblock ? " non-block" : "",
 			    setup->partialfrag ? " partial-frag" : "",
-			    setup->nosilence ? " no-silence" : "");
+			    setup->nosilence ? " no-silence" : "",
+			    setup->hqrate ? " hq-rate" : "");
 		setup = setup->next;
 	}
 	mutex_unlock(&pstr->oss.setup_mutex);
@@ -3006,6 +3007,8 @@ static void snd_pcm_oss_proc_write(struct snd_info_entry *entry,
 				template.nosilence = 1;
 			} else if (!strcmp(str, "buggy-ptr")) {
 				template.buggyptr = 1;
+			} else if (!strcmp(str, "hq-rate")) {
+				template.hqrate = 1;
 			}
 		} while (*str);
 		if (setup == NULL) {
@@ -3189,11 +3192,13 @@ static int __init alsa_pcm_oss_init(void)
 	}
 	if ((err = snd_pcm_notify(&snd_pcm_oss_notify, 0)) < 0)
 		return err;
+	snd_pcm_rate_test_init();
 	return 0;
 }
 
 static void __exit alsa_pcm_oss_exit(void)
 {
+	snd_pcm_rate_test_exit();
 	snd_pcm_notify(&snd_pcm_oss_notify, 1);
 }
 
@@ -760,6 +760,18 @@ int snd_pcm_area_copy(const struct snd_pcm_channel_area *src_area, size_t src_of
 				dstbit = 0;
 			}
 		}
+	} else if (width == 16) {
+		while (samples-- > 0) {
+			*(u16 *)dst = *(const u16 *)src;
+			src += src_step;
+			dst += dst_step;
+		}
+	} else if (width == 32) {
+		while (samples-- > 0) {
+			*(u32 *)dst = *(const u32 *)src;
+			src += src_step;
+			dst += dst_step;
+		}
 	} else {
 		width /= 8;
 		while (samples-- > 0) {
@@ -159,6 +159,14 @@ static inline int snd_pcm_plug_slave_format(int format, const struct snd_mask *f
 
 #endif
 
+#ifdef CONFIG_SND_PCM_OSS_RATE_KUNIT_TEST
+int snd_pcm_rate_test_init(void);
+void snd_pcm_rate_test_exit(void);
+#else
+static inline int snd_pcm_rate_test_init(void) { return 0; }
+static inline void snd_pcm_rate_test_exit(void) {}
+#endif
+
 #ifdef PLUGIN_DEBUG
 #define pdprintf(fmt, args...) printk(KERN_DEBUG "plugin: " fmt, ##args)
 #else
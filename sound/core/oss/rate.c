@@ -20,6 +20,9 @@
  */
   
 #include <linux/time.h>
+#include <linux/fixp-arith.h>
+#include <linux/gcd.h>
+#include <linux/mm.h>
 #include <sound/core.h>
 #include <sound/pcm.h>
 #include "pcm_plugin.h"
@@ -32,9 +35,31 @@
  *  Basic rate conversion plugin
  */
 
+/*
+ *  Polyphase FIR mode ("hq-rate" OSS setup option)
+ *
+ *  The ratio dst/src is reduced to L/M and a windowed-sinc low-pass filter
+ *  with FIR_TAPS * L coefficients is split into L phases.  Each output sample
+ *  is then a dot product of FIR_TAPS coefficients of one phase with the last
+ *  FIR_TAPS input samples.  The history is kept twice in a row, so that the
+ *  input window is always contiguous and the inner loop is a plain
+ *  multiply-accumulate over two s16 arrays.
+ */
+#define FIR_TAPS	32
+/* enough for ratios within a rate family, 44.1k <-> 48k and 44.1k -> 96k;
+ * other cross-family ratios such as 8k -> 44.1k (L = 441) stay linear
+ */
+#define FIR_MAX_PHASES	320
+#define FIR_COEF_SHIFT	14
+#define FIR_CUTOFF_NUM	43		/* cutoff at 0.86 of the lower Nyquist */
+#define FIR_CUTOFF_DEN	100
+#define FIR_TWOPI	(360 * 256)
+
 struct rate_channel {
 	signed short last_S1;
 	signed short last_S2;
+	unsigned int hist_pos;
+	signed short hist[FIR_TAPS * 2];
 };
  
 typedef void (*rate_f)(struct snd_pcm_plugin *plugin,
@@ -47,6 +72,11 @@ struct rate_priv {
 	unsigned int pos;
 	rate_f func;
 	snd_pcm_sframes_t old_src_frames, old_dst_frames;
+	/* polyphase FIR mode */
+	signed short *coef;		/* FIR_TAPS * fir_l coefficients */
+	unsigned int fir_l, fir_m;	/* interpolation / decimation factors */
+	/* frames of the last playback transfer, for the count back */
+	snd_pcm_uframes_t fir_src_done, fir_dst_done;
 	struct rate_channel channels[];
 };
 
@@ -54,11 +84,183 @@ static void rate_init(struct snd_pcm_plugin *plugin)
 {
 	unsigned int channel;
 	struct rate_priv *data = (struct rate_priv *)plugin->extra_data;
-	data->pos = 0;
+	/* in FIR mode, consume the first sample before the first output */
+	data->pos = data->coef ? data->fir_l : 0;
+	data->fir_src_done = data->fir_dst_done = 0;
 	for (channel = 0; channel < plugin->src_format.channels; channel++) {
 		data->channels[channel].last_S1 = 0;
 		data->channels[channel].last_S2 = 0;
+		data->channels[channel].hist_pos = 0;
+		memset(data->channels[channel].hist, 0,
+		       sizeof(data->channels[channel].hist));
+	}
+}
+
+static inline signed short fir_dot(const signed short *coef,
+				   const signed short *x)
+{
+	s32 acc = 1 << (FIR_COEF_SHIFT - 1);
+	int i;
+
+	for (i = 0; i < FIR_TAPS; i++)
+		acc += (s32)coef[i] * x[i];
+	acc >>= FIR_COEF_SHIFT;
+	return clamp_t(s32, acc, -32768, 32767);
+}
+
+static void resample_fir(struct snd_pcm_plugin *plugin,
+			 const struct snd_pcm_plugin_channel *src_channels,
+			 struct snd_pcm_plugin_channel *dst_channels,
+			 int src_frames, int dst_frames)
+{
+	struct rate_priv *data = (struct rate_priv *)plugin->extra_data;
+	unsigned int l = data->fir_l, m = data->fir_m;
+	unsigned int channel, phase = data->pos;
+
+	for (channel = 0; channel < plugin->src_format.channels; channel++) {
+		struct rate_channel *rchan = &data->channels[channel];
+		unsigned int hpos = rchan->hist_pos;
+		signed short *src, *dst;
+		int src_step, dst_step;
+		int src_frames1, dst_frames1;
+
+		phase = data->pos;
+		if (!src_channels[channel].enabled) {
+			if (dst_channels[channel].wanted)
+				snd_pcm_area_silence(&dst_channels[channel].area, 0, dst_frames, plugin->dst_format.format);
+			dst_channels[channel].enabled = 0;
+			continue;
+		}
+		dst_channels[channel].enabled = 1;
+		src = (signed short *)src_channels[channel].area.addr +
+			src_channels[channel].area.first / 8 / 2;
+		dst = (signed short *)dst_channels[channel].area.addr +
+			dst_channels[channel].area.first / 8 / 2;
+		src_step = src_channels[channel].area.step / 8 / 2;
+		dst_step = dst_channels[channel].area.step / 8 / 2;
+		src_frames1 = src_frames;
+		dst_frames1 = dst_frames;
+		while (dst_frames1-- > 0) {
+			while (phase >= l) {
+				phase -= l;
+				if (src_frames1-- > 0) {
+					rchan->hist[hpos] = *src;
+					rchan->hist[hpos + FIR_TAPS] = *src;
+					hpos = (hpos + 1) % FIR_TAPS;
+					src += src_step;
+				}
+			}
+			/* hist[hpos..hpos+FIR_TAPS-1] is oldest to newest */
+			*dst = fir_dot(data->coef + phase * FIR_TAPS,
+				       rchan->hist + hpos);
+			dst += dst_step;
+			phase += m;
+		}
+		/* the input left over belongs to the next outputs */
+		while (phase >= l && src_frames1-- > 0) {
+			phase -= l;
+			rchan->hist[hpos] = *src;
+			rchan->hist[hpos + FIR_TAPS] = *src;
+			hpos = (hpos + 1) % FIR_TAPS;
+			src += src_step;
+		}
+		rchan->hist_pos = hpos;
 	}
+	data->pos = phase;
+}
+
+/* Blackman window in Q31 */
+static s64 fir_window(unsigned int i, unsigned int n)
+{
+	u32 a = div_u64((u64)i * FIR_TWOPI, n - 1);
+
+	return (42LL << 31) / 100 -
+		(s64)fixp_cos32_rad(a % FIR_TWOPI, FIR_TWOPI) / 2 +
+		(s64)fixp_cos32_rad((2 * a) % FIR_TWOPI, FIR_TWOPI) * 8 / 100;
+}
+
+/* build the polyphase coefficient table for the ratio l/m; the prototype
+ * is a windowed sinc with the cutoff below the lower of both Nyquist
+ * frequencies, and each phase is normalized to unity DC gain
+ */
+static signed short *fir_build_coef(unsigned int l, unsigned int m)
+{
+	unsigned int n = FIR_TAPS * l;
+	unsigned int k = max(l, m);
+	signed short *coef;
+	s64 *proto;
+	unsigned int i, p, t;
+
+	proto = kvmalloc_array(n, sizeof(*proto), GFP_KERNEL);
+	if (!proto)
+		return NULL;
+	coef = kvmalloc_array(n, sizeof(*coef), GFP_KERNEL);
+	if (!coef) {
+		kvfree(proto);
+		return NULL;
+	}
+
+	for (i = 0; i < n; i++) {
+		/* d = 2 * (i - center), so that it stays integer */
+		s64 d = 2 * (s64)i - (n - 1);
+		s64 h;
+
+		if (!d) {
+			h = div_s64((s64)FIR_CUTOFF_NUM * 2 << 31,
+				    FIR_CUTOFF_DEN);
+			h = div_s64(h * l, k);
+		} else {
+			/* sin(pi * x) / (pi * x) with x = 2 * fc * d / 2 */
+			u64 ad = abs(d);
+			u32 a = div_u64(ad * FIR_CUTOFF_NUM * (FIR_TWOPI / 2),
+					FIR_CUTOFF_DEN * k);
+			s64 sn = fixp_sin32_rad(a % FIR_TWOPI, FIR_TWOPI);
+
+			/* 2 * l * sin / (pi * d), pi ~= 355 / 113 */
+			h = div_s64(sn * 2 * l * 113, 355 * ad);
+		}
+		proto[i] = (h >> 16) * (fir_window(i, n) >> 15) >> 16;
+	}
+
+	for (p = 0; p < l; p++) {
+		s64 sum = 0;
+
+		for (t = 0; t < FIR_TAPS; t++)
+			sum += proto[p + t * l];
+		if (!sum)
+			sum = 1;
+		/* reversed order: coefficients apply oldest to newest */
+		for (t = 0; t < FIR_TAPS; t++)
+			coef[p * FIR_TAPS + FIR_TAPS - 1 - t] =
+				div_s64(proto[p + t * l] << FIR_COEF_SHIFT,
+					sum);
+	}
+	kvfree(proto);
+	return coef;
+}
+
+static int rate_setup_fir(struct rate_priv *data, unsigned int src_rate,
+			  unsigned int dst_rate)
+{
+	unsigned int g = gcd(src_rate, dst_rate);
+
+	if (dst_rate / g > FIR_MAX_PHASES)
+		return -EINVAL;
+	data->fir_l = dst_rate / g;
+	data->fir_m = src_rate / g;
+	data->coef = fir_build_coef(data->fir_l, data->fir_m);
+	if (!data->coef)
+		return -ENOMEM;
+	data->func = resample_fir;
+	return 0;
+}
+
+static void rate_private_free(struct snd_pcm_plugin *plugin)
+{
+	struct rate_priv *data = (struct rate_priv *)plugin->extra_data;
+
+	kvfree(data->coef);
+	data->coef = NULL;
 }
 
 static void resample_expand(struct snd_pcm_plugin *plugin,
@@ -180,6 +382,30 @@ static void resample_shrink(struct snd_pcm_plugin *plugin,
 	data->pos = pos;
 }
 
+/*
+ * In FIR mode the input is consumed at exactly fir_m / fir_l per output,
+ * so the counts are exact for the current phase: an output needs a new
+ * input frame for each time the phase passes fir_l, i.e. the first n
+ * outputs take (pos + (n - 1) * fir_m) / fir_l input frames.
+ */
+static snd_pcm_uframes_t fir_src_frames(struct rate_priv *data,
+					snd_pcm_uframes_t frames)
+{
+	return div_u64(data->pos + (u64)(frames - 1) * data->fir_m,
+		       data->fir_l);
+}
+
+/* the most outputs that don't need more than frames input frames */
+static snd_pcm_uframes_t fir_dst_frames(struct rate_priv *data,
+					snd_pcm_uframes_t frames)
+{
+	u64 limit = (u64)(frames + 1) * data->fir_l;
+
+	if (limit <= data->pos)
+		return 0;
+	return div_u64(limit - data->pos - 1, data->fir_m) + 1;
+}
+
 static snd_pcm_sframes_t rate_src_frames(struct snd_pcm_plugin *plugin, snd_pcm_uframes_t frames)
 {
 	struct rate_priv *data;
@@ -190,6 +416,16 @@ static snd_pcm_sframes_t rate_src_frames(struct snd_pcm_plugin *plugin, snd_pcm_
 	if (frames == 0)
 		return 0;
 	data = (struct rate_priv *)plugin->extra_data;
+	if (data->coef) {
+		/* the playback chain asks back what the transfer consumed,
+		 * after the phase has moved on
+		 */
+		if (data->fir_dst_done && frames == data->fir_dst_done) {
+			data->fir_dst_done = 0;
+			return data->fir_src_done;
+		}
+		return fir_src_frames(data, frames);
+	}
 	if (plugin->src_format.rate < plugin->dst_format.rate) {
 		res = (((frames * data->pitch) + (BITS/2)) >> SHIFT);
 	} else {
@@ -223,6 +459,10 @@ static snd_pcm_sframes_t rate_dst_frames(struct snd_pcm_plugin *plugin, snd_pcm_
 	if (frames == 0)
 		return 0;
 	data = (struct rate_priv *)plugin->extra_data;
+	if (data->coef) {
+		data->fir_dst_done = 0;
+		return fir_dst_frames(data, frames);
+	}
 	if (plugin->src_format.rate < plugin->dst_format.rate) {
 		res = (((frames << SHIFT) + (data->pitch / 2)) / data->pitch);
 	} else {
@@ -276,6 +516,13 @@ static snd_pcm_sframes_t rate_transfer(struct snd_pcm_plugin *plugin,
 	if (dst_frames > dst_channels[0].frames)
 		dst_frames = dst_channels[0].frames;
 	data = (struct rate_priv *)plugin->extra_data;
+	if (data->coef && plugin->stream == SNDRV_PCM_STREAM_PLAYBACK) {
+		/* a cut output leaves the rest of the input for later */
+		data->fir_src_done = min_t(u64, frames,
+					   div_u64(data->pos + (u64)dst_frames *
+						   data->fir_m, data->fir_l));
+		data->fir_dst_done = dst_frames;
+	}
 	data->func(plugin, src_channels, dst_channels, frames, dst_frames);
 	return dst_frames;
 }
@@ -336,6 +583,9 @@ int snd_pcm_plugin_build_rate(struct snd_pcm_substream *plug,
 		data->pitch = ((dst_format->rate << SHIFT) + (src_format->rate >> 1)) / src_format->rate;
 		data->func = resample_shrink;
 	}
+	/* fall back to the linear interpolation for unsupported ratios */
+	if (plug->oss.setup.hqrate)
+		rate_setup_fir(data, src_format->rate, dst_format->rate);
 	data->pos = 0;
 	rate_init(plugin);
 	data->old_src_frames = data->old_dst_frames = 0;
@@ -343,6 +593,7 @@ int snd_pcm_plugin_build_rate(struct snd_pcm_substream *plug,
 	plugin->src_frames = rate_src_frames;
 	plugin->dst_frames = rate_dst_frames;
 	plugin->action = rate_action;
+	plugin->private_free = rate_private_free;
 	*r_plugin = plugin;
 	return 0;
 }
@@ -0,0 +1,301 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *  KUnit tests of the rate conversion Plug-In
+ *
+ *  A sine is converted between 44.1kHz and 48kHz in both directions with
+ *  the linear interpolation and with the polyphase FIR mode, and the
+ *  THD+N of the result is measured by fitting the ideal sine at the output
+ *  rate; everything else in the output counts as distortion and noise.
+ *  The FIR mode is also fed in many small transfers with the frame counts
+ *  the plugin chain uses, which must neither drop nor repeat input.
+ *  The conversion throughput is reported as well.
+ */
+
+#include <kunit/test.h>
+#include <linux/fixp-arith.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <sound/core.h>
+#include <sound/pcm.h>
+#include "pcm_plugin.h"
+
+#define TEST_TWOPI	(360 * 256)
+#define TEST_AMPLITUDE	16384		/* -6dBFS */
+#define TEST_FRAMES	8192		/* source frames */
+#define TEST_SKIP	512		/* output frames of filter start-up */
+
+static s32 test_sin(unsigned int freq, unsigned int n, unsigned int rate)
+{
+	u32 a = div_u64((u64)(freq * n % rate) * TEST_TWOPI, rate);
+
+	return fixp_sin32_rad(a, TEST_TWOPI);
+}
+
+static s32 test_cos(unsigned int freq, unsigned int n, unsigned int rate)
+{
+	u32 a = div_u64((u64)(freq * n % rate) * TEST_TWOPI, rate);
+
+	return fixp_cos32_rad(a, TEST_TWOPI);
+}
+
+static struct snd_pcm_plugin *test_build(struct kunit *test, bool hq,
+					 int stream, unsigned int src_rate,
+					 unsigned int dst_rate)
+{
+	struct snd_pcm_plugin_format src_format = {
+		.format = SNDRV_PCM_FORMAT_S16,
+		.rate = src_rate,
+		.channels = 1,
+	};
+	struct snd_pcm_plugin_format dst_format = src_format;
+	struct snd_pcm_substream *plug;
+	struct snd_pcm_plugin *plugin;
+
+	plug = kunit_kzalloc(test, sizeof(*plug), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, plug);
+	plug->stream = stream;
+	plug->oss.setup.hqrate = hq;
+	dst_format.rate = dst_rate;
+	KUNIT_ASSERT_EQ(test, 0, snd_pcm_plugin_build_rate(plug, &src_format,
+							   &dst_format,
+							   &plugin));
+	return plugin;
+}
+
+static void test_channel(struct snd_pcm_plugin_channel *channel, s16 *buf,
+			 snd_pcm_uframes_t frames)
+{
+	memset(channel, 0, sizeof(*channel));
+	channel->area.addr = buf;
+	channel->area.step = 16;
+	channel->frames = frames;
+	channel->enabled = 1;
+	channel->wanted = 1;
+}
+
+/* convert src to dst, return the number of output frames */
+static snd_pcm_sframes_t test_convert(struct kunit *test, bool hq,
+				      unsigned int src_rate,
+				      unsigned int dst_rate,
+				      s16 *src, s16 *dst,
+				      snd_pcm_uframes_t dst_size)
+{
+	struct snd_pcm_plugin_channel src_channel, dst_channel;
+	struct snd_pcm_plugin *plugin;
+	snd_pcm_sframes_t frames;
+	u64 ns;
+
+	plugin = test_build(test, hq, SNDRV_PCM_STREAM_PLAYBACK, src_rate,
+			    dst_rate);
+	test_channel(&src_channel, src, TEST_FRAMES);
+	test_channel(&dst_channel, dst, dst_size);
+
+	ns = ktime_get_ns();
+	frames = plugin->transfer(plugin, &src_channel, &dst_channel,
+				  TEST_FRAMES);
+	ns = ktime_get_ns() - ns;
+	snd_pcm_plugin_free(plugin);
+
+	kunit_info(test, "%s: %u -> %u Hz, %ld frames in %llu ns\n",
+		   hq ? "fir" : "linear", src_rate, dst_rate, (long)frames,
+		   ns);
+	return frames;
+}
+
+/* convert src to dst in chunks of varying size with the frame counts of
+ * the plugin chain, return the number of output frames
+ */
+static snd_pcm_sframes_t test_convert_chunks(struct kunit *test, int stream,
+					     unsigned int src_rate,
+					     unsigned int dst_rate,
+					     s16 *src, s16 *dst,
+					     snd_pcm_uframes_t dst_size)
+{
+	struct snd_pcm_plugin_channel src_channel, dst_channel;
+	struct snd_pcm_plugin *plugin;
+	snd_pcm_sframes_t in = 0, out = 0, src_frames, dst_frames, frames;
+	unsigned int i;
+
+	plugin = test_build(test, true, stream, src_rate, dst_rate);
+	for (i = 0; ; i++) {
+		frames = 1 + (i * 37) % 257;
+		if (stream == SNDRV_PCM_STREAM_PLAYBACK) {
+			src_frames = min_t(snd_pcm_sframes_t, frames,
+					   TEST_FRAMES - in);
+			if (!src_frames)
+				break;
+			dst_frames = plugin->dst_frames(plugin, src_frames);
+		} else {
+			dst_frames = frames;
+			src_frames = plugin->src_frames(plugin, dst_frames);
+			if (in + src_frames > TEST_FRAMES)
+				break;
+		}
+		if (out + dst_frames > dst_size)
+			break;
+
+		test_channel(&src_channel, src + in, src_frames);
+		test_channel(&dst_channel, dst + out, dst_frames);
+		frames = plugin->transfer(plugin, &src_channel, &dst_channel,
+					  src_frames);
+		KUNIT_EXPECT_EQ(test, frames, dst_frames);
+		/* the playback chain counts back what was consumed */
+		if (stream == SNDRV_PCM_STREAM_PLAYBACK)
+			KUNIT_EXPECT_EQ(test, src_frames,
+					plugin->src_frames(plugin, frames));
+		in += src_frames;
+		out += frames;
+	}
+	snd_pcm_plugin_free(plugin);
+
+	kunit_info(test, "%s: %u -> %u Hz, %ld -> %ld frames in %u transfers\n",
+		   stream == SNDRV_PCM_STREAM_PLAYBACK ? "playback" : "capture",
+		   src_rate, dst_rate, (long)in, (long)out, i);
+	/* no input frame dropped or repeated */
+	KUNIT_EXPECT_LT(test, abs((s64)out * src_rate - (s64)in * dst_rate),
+			(s64)max(src_rate, dst_rate));
+	return out;
+}
+
+/* THD+N of a sine of freq (a multiple of 10Hz) in dB, in 1dB steps */
+static int test_thdn(const s16 *y, unsigned int freq, unsigned int rate)
+{
+	unsigned int n, len = rate / 10;	/* whole periods only */
+	s64 a = 0, b = 0, as, ac, m, r;
+	u64 res = 0, fund = 0;
+	int db;
+
+	for (n = 0; n < len; n++) {
+		a += (s64)y[n] * test_sin(freq, n, rate);
+		b += (s64)y[n] * test_cos(freq, n, rate);
+	}
+	/* amplitudes of the sine and cosine parts in Q31 */
+	as = div_s64(2 * a, len);
+	ac = div_s64(2 * b, len);
+	for (n = 0; n < len; n++) {
+		m = ((as >> 16) * (test_sin(freq, n, rate) >> 15) +
+		     (ac >> 16) * (test_cos(freq, n, rate) >> 15) +
+		     (1 << 30)) >> 31;
+		r = y[n] - m;
+		res += r * r;
+		fund += m * m;
+	}
+
+	for (db = 0; db < 120 && res * 1259 <= fund * 1000; db++)
+		res = div_u64(res * 1259, 1000);	/* 10^(1/10) */
+	return -db;
+}
+
+static void test_rate_thdn(struct kunit *test, unsigned int src_rate,
+			   unsigned int dst_rate, unsigned int freq)
+{
+	snd_pcm_uframes_t dst_size = TEST_FRAMES * 2;
+	snd_pcm_sframes_t frames;
+	int linear, fir;
+	s16 *src, *dst;
+	unsigned int n;
+
+	src = kunit_kmalloc(test, TEST_FRAMES * sizeof(*src), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, src);
+	dst = kunit_kmalloc(test, dst_size * sizeof(*dst), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dst);
+	for (n = 0; n < TEST_FRAMES; n++)
+		src[n] = (TEST_AMPLITUDE * (test_sin(freq, n, src_rate) >> 16))
+			>> 15;
+
+	frames = test_convert(test, false, src_rate, dst_rate, src, dst,
+			      dst_size);
+	KUNIT_ASSERT_GE(test, frames, (snd_pcm_sframes_t)(TEST_SKIP +
+							   dst_rate / 10));
+	linear = test_thdn(dst + TEST_SKIP, freq, dst_rate);
+
+	frames = test_convert(test, true, src_rate, dst_rate, src, dst,
+			      dst_size);
+	KUNIT_ASSERT_GE(test, frames, (snd_pcm_sframes_t)(TEST_SKIP +
+							   dst_rate / 10));
+	fir = test_thdn(dst + TEST_SKIP, freq, dst_rate);
+
+	kunit_info(test, "THD+N at %u Hz: linear %d dB, fir %d dB\n",
+		   freq, linear, fir);
+	KUNIT_EXPECT_LE(test, fir, -60);
+	KUNIT_EXPECT_LE(test, fir, linear - 20);
+}
+
+static void test_rate_chunks(struct kunit *test, int stream,
+			     unsigned int src_rate, unsigned int dst_rate)
+{
+	snd_pcm_uframes_t dst_size = TEST_FRAMES * 2;
+	snd_pcm_sframes_t frames;
+	unsigned int n, freq = 1000;
+	s16 *src, *dst;
+	int thdn;
+
+	src = kunit_kmalloc(test, TEST_FRAMES * sizeof(*src), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, src);
+	dst = kunit_kmalloc(test, dst_size * sizeof(*dst), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dst);
+	for (n = 0; n < TEST_FRAMES; n++)
+		src[n] = (TEST_AMPLITUDE * (test_sin(freq, n, src_rate) >> 16))
+			>> 15;
+
+	frames = test_convert_chunks(test, stream, src_rate, dst_rate, src, dst,
+				     dst_size);
+	KUNIT_ASSERT_GE(test, frames, (snd_pcm_sframes_t)(TEST_SKIP +
+							   dst_rate / 10));
+	/* a dropped or repeated frame at a chunk boundary shows up here */
+	thdn = test_thdn(dst + TEST_SKIP, freq, dst_rate);
+	kunit_info(test, "THD+N at %u Hz: fir %d dB\n", freq, thdn);
+	KUNIT_EXPECT_LE(test, thdn, -60);
+}
+
+static void test_rate_44100_48000(struct kunit *test)
+{
+	test_rate_thdn(test, 44100, 48000, 1000);
+	test_rate_thdn(test, 44100, 48000, 5000);
+}
+
+static void test_rate_48000_44100(struct kunit *test)
+{
+	test_rate_thdn(test, 48000, 44100, 1000);
+	test_rate_thdn(test, 48000, 44100, 5000);
+}
+
+static void test_rate_playback_chunks(struct kunit *test)
+{
+	test_rate_chunks(test, SNDRV_PCM_STREAM_PLAYBACK, 44100, 48000);
+	test_rate_chunks(test, SNDRV_PCM_STREAM_PLAYBACK, 48000, 44100);
+}
+
+static void test_rate_capture_chunks(struct kunit *test)
+{
+	test_rate_chunks(test, SNDRV_PCM_STREAM_CAPTURE, 44100, 48000);
+	test_rate_chunks(test, SNDRV_PCM_STREAM_CAPTURE, 48000, 44100);
+}
+
+static struct kunit_case snd_pcm_rate_test_cases[] = {
+	KUNIT_CASE(test_rate_44100_48000),
+	KUNIT_CASE(test_rate_48000_44100),
+	KUNIT_CASE(test_rate_playback_chunks),
+	KUNIT_CASE(test_rate_capture_chunks),
+	{}
+};
+
+static struct kunit_suite snd_pcm_rate_test_suite = {
+	.name = "snd-pcm-oss-rate",
+	.test_cases = snd_pcm_rate_test_cases,
+};
+
+static struct kunit_suite *snd_pcm_rate_test_suites[] = {
+	&snd_pcm_rate_test_suite, NULL
+};
+
+/* called from the module init, as the plugins are internal to it */
+int snd_pcm_rate_test_init(void)
+{
+	return __kunit_test_suites_init(snd_pcm_rate_test_suites);
+}
+
+void snd_pcm_rate_test_exit(void)
+{
+	__kunit_test_suites_exit(snd_pcm_rate_test_suites);
+}
@@ -470,10 +470,62 @@ static void snd_pcm_substream_proc_status_read(struct snd_info_entry *entry,
 	snd_iprintf(buffer, "-----\n");
 	snd_iprintf(buffer, "hw_ptr      : %ld\n", runtime->status->hw_ptr);
 	snd_iprintf(buffer, "appl_ptr    : %ld\n", runtime->control->appl_ptr);
+	if (runtime->refine_cache)
+		snd_iprintf(buffer, "hw_refine   : %u hits / %u calls\n",
+			    runtime->refine_hits, runtime->refine_calls);
  unlock:
 	mutex_unlock(&substream->pcm->open_mutex);
 }
 
+static const char * const snd_pcm_hist_names[SNDRV_PCM_HIST_NUM] = {
+	[SNDRV_PCM_HIST_PERIOD_JITTER] = "period_jitter_us",
+	[SNDRV_PCM_HIST_HWPTR_STEP] = "hwptr_step_frames",
+	[SNDRV_PCM_HIST_IRQ_WAKE] = "irq_to_wakeup_us",
+	[SNDRV_PCM_HIST_WAKE_APPL] = "wakeup_to_appl_us",
+};
+
+static void snd_pcm_substream_proc_timing_read(struct snd_info_entry *entry,
+					       struct snd_info_buffer *buffer)
+{
+	struct snd_pcm_substream *substream = entry->private_data;
+	struct snd_pcm_hist *hist;
+	unsigned long sum;
+	int cpu, type, i;
+
+	if (!substream->hist)
+		return;
+	snd_iprintf(buffer, "%-18s", "bucket <");
+	for (i = 0; i < SNDRV_PCM_HIST_BUCKETS - 1; i++)
+		snd_iprintf(buffer, " %7lu", 1UL << i);
+	snd_iprintf(buffer, " %7s\n", "more");
+	for (type = 0; type < SNDRV_PCM_HIST_NUM; type++) {
+		snd_iprintf(buffer, "%-18s", snd_pcm_hist_names[type]);
+		for (i = 0; i < SNDRV_PCM_HIST_BUCKETS; i++) {
+			sum = 0;
+			for_each_possible_cpu(cpu) {
+				hist = per_cpu_ptr(substream->hist, cpu);
+				sum += READ_ONCE(hist->count[type][i]);
+			}
+			snd_iprintf(buffer, " %7lu", sum);
+		}
+		snd_iprintf(buffer, "\n");
+	}
+}
+
+/* any write clears the histograms */
+static void snd_pcm_substream_proc_timing_write(struct snd_info_entry *entry,
+						struct snd_info_buffer *buffer)
+{
+	struct snd_pcm_substream *substream = entry->private_data;
+	int cpu;
+
+	if (!substream->hist)
+		return;
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(substream->hist, cpu), 0,
+		       sizeof(struct snd_pcm_hist));
+}
+
 #ifdef CONFIG_SND_PCM_XRUN_DEBUG
 static void snd_pcm_xrun_injection_write(struct snd_info_entry *entry,
 					 struct snd_info_buffer *buffer)
@@ -576,6 +628,16 @@ static int snd_pcm_substream_proc_init(struct snd_pcm_substream *substream)
 	create_substream_info_entry(substream, "status",
 				    snd_pcm_substream_proc_status_read);
 
+	substream->hist = alloc_percpu(struct snd_pcm_hist);
+	if (substream->hist) {
+		entry = create_substream_info_entry(substream, "timing",
+					snd_pcm_substream_proc_timing_read);
+		if (entry) {
+			entry->c.text.write = snd_pcm_substream_proc_timing_write;
+			entry->mode |= 0200;
+		}
+	}
+
 #ifdef CONFIG_SND_PCM_XRUN_DEBUG
 	entry = create_substream_info_entry(substream, "xrun_injection", NULL);
 	if (entry) {
@@ -672,6 +734,7 @@ int snd_pcm_new_stream(struct snd_pcm *pcm, int stream, int substream_count)
 		substream->stream = stream;
 		sprintf(substream->name, "subdevice #%i", idx);
 		substream->buffer_bytes_max = UINT_MAX;
+		snd_pcm_tsched_init(substream);
 		if (prev == NULL)
 			pstr->substream = substream;
 		else
@@ -829,6 +892,9 @@ static void snd_pcm_free_stream(struct snd_pcm_str * pstr)
 	while (substream) {
 		substream_next = substream->next;
 		snd_pcm_timer_done(substream);
+#ifdef CONFIG_SND_VERBOSE_PROCFS
+		free_percpu(substream->hist);
+#endif
 		kfree(substream);
 		substream = substream_next;
 	}
@@ -910,7 +976,7 @@ int snd_pcm_attach_substream(struct snd_pcm *pcm, int stream,
 		}
 	}
 
-	if (file->f_flags & O_APPEND) {
+	if (file && (file->f_flags & O_APPEND)) {
 		if (prefer_subdevice < 0) {
 			if (pstr->substream_count > 1)
 				return -EINVAL; /* must be unique */
@@ -969,7 +1035,7 @@ int snd_pcm_attach_substream(struct snd_pcm *pcm, int stream,
 	substream->runtime = runtime;
 	substream->private_data = pcm->private_data;
 	substream->ref_count = 1;
-	substream->f_flags = file->f_flags;
+	substream->f_flags = file ? file->f_flags : 0;
 	substream->pid = get_pid(task_pid(current));
 	pstr->substream_opened++;
 	*rsubstream = substream;
@@ -1186,6 +1252,7 @@ static void snd_pcm_proc_read(struct snd_info_entry *entry,
 }
 
 static struct snd_info_entry *snd_pcm_proc_entry;
+static struct snd_info_entry *snd_pcm_pool_proc_entry;
 
 static void snd_pcm_proc_init(void)
 {
@@ -1200,10 +1267,21 @@ static void snd_pcm_proc_init(void)
 		}
 	}
 	snd_pcm_proc_entry = entry;
+
+	entry = snd_info_create_module_entry(THIS_MODULE, "pcm_pool", NULL);
+	if (entry) {
+		snd_info_set_text_ops(entry, NULL, snd_pcm_pool_proc_read);
+		if (snd_info_register(entry) < 0) {
+			snd_info_free_entry(entry);
+			entry = NULL;
+		}
+	}
+	snd_pcm_pool_proc_entry = entry;
 }
 
 static void snd_pcm_proc_done(void)
 {
+	snd_info_free_entry(snd_pcm_pool_proc_entry);
 	snd_info_free_entry(snd_pcm_proc_entry);
 }
 
@@ -314,6 +314,65 @@ static int snd_pcm_ioctl_xferi_compat(struct snd_pcm_substream *substream,
 }
 
 
+/* snd_xferiv needs remapping of the whole segment array */
+struct snd_xferi_iov32 {
+	u32 buf;
+	u32 frames;
+};
+
+struct snd_xferiv32 {
+	s32 result;
+	u32 iov;
+	u32 nr_segs;
+};
+
+static int snd_pcm_ioctl_xferiv_compat(struct snd_pcm_substream *substream,
+				       struct snd_xferiv32 __user *data32)
+{
+	struct snd_xferi_iov32 __user *iovptr;
+	struct snd_xferi_iov *iov;
+	compat_caddr_t ptr;
+	u32 nr_segs, i;
+	snd_pcm_sframes_t result;
+	int err = 0;
+
+	if (! substream->runtime)
+		return -ENOTTY;
+	if (substream->stream != SNDRV_PCM_STREAM_PLAYBACK)
+		return -EINVAL;
+	if (substream->runtime->status->state == SNDRV_PCM_STATE_OPEN)
+		return -EBADFD;
+
+	if (get_user(ptr, &data32->iov) ||
+	    get_user(nr_segs, &data32->nr_segs))
+		return -EFAULT;
+	if (!nr_segs)
+		return 0;
+	if (nr_segs > SNDRV_PCM_XFERIV_MAX_SEGS)
+		return -EINVAL;
+	iovptr = compat_ptr(ptr);
+	iov = kmalloc_array(nr_segs, sizeof(*iov), GFP_KERNEL);
+	if (iov == NULL)
+		return -ENOMEM;
+	for (i = 0; i < nr_segs; i++, iovptr++) {
+		u32 buf, frames;
+		if (get_user(buf, &iovptr->buf) ||
+		    get_user(frames, &iovptr->frames)) {
+			kfree(iov);
+			return -EFAULT;
+		}
+		iov[i].buf = compat_ptr(buf);
+		iov[i].frames = frames;
+	}
+	result = snd_pcm_lib_write_iov(substream, iov, nr_segs);
+	if (result < 0)
+		err = result;
+	else if (put_user(result, &data32->result))	/* copy the result */
+		err = -EFAULT;
+	kfree(iov);
+	return err;
+}
+
 /* snd_xfern needs remapping of bufs */
 struct snd_xfern32 {
 	s32 result;
@@ -482,6 +541,7 @@ enum {
 	SNDRV_PCM_IOCTL_READI_FRAMES32 = _IOR('A', 0x51, struct snd_xferi32),
 	SNDRV_PCM_IOCTL_WRITEN_FRAMES32 = _IOW('A', 0x52, struct snd_xfern32),
 	SNDRV_PCM_IOCTL_READN_FRAMES32 = _IOR('A', 0x53, struct snd_xfern32),
+	SNDRV_PCM_IOCTL_WRITEIV_FRAMES32 = _IOW('A', 0x54, struct snd_xferiv32),
 	SNDRV_PCM_IOCTL_STATUS_COMPAT64 = _IOR('A', 0x20, struct compat_snd_pcm_status64),
 	SNDRV_PCM_IOCTL_STATUS_EXT_COMPAT64 = _IOWR('A', 0x24, struct compat_snd_pcm_status64),
 #ifdef CONFIG_X86_X32
@@ -556,6 +616,8 @@ static long snd_pcm_ioctl_compat(struct file *file, unsigned int cmd, unsigned l
 		return snd_pcm_ioctl_xfern_compat(substream, SNDRV_PCM_STREAM_PLAYBACK, argp);
 	case SNDRV_PCM_IOCTL_READN_FRAMES32:
 		return snd_pcm_ioctl_xfern_compat(substream, SNDRV_PCM_STREAM_CAPTURE, argp);
+	case SNDRV_PCM_IOCTL_WRITEIV_FRAMES32:
+		return snd_pcm_ioctl_xferiv_compat(substream, argp);
 	case SNDRV_PCM_IOCTL_DELAY32:
 		return snd_pcm_ioctl_delay_compat(substream, argp);
 	case SNDRV_PCM_IOCTL_REWIND32:
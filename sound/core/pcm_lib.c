@@ -204,6 +204,91 @@ int snd_pcm_update_state(struct snd_pcm_substream *substream,
 	return 0;
 }
 
+/*
+ * Timer-based wakeup (tsched mode)
+ *
+ * With SNDRV_PCM_HW_PARAMS_TIMER_WAKEUP, poll() and blocking read/write
+ * don't depend on period interrupts, so the hardware may run with huge
+ * periods or none at all.  Instead, a waiter arms an hrtimer for the time
+ * when the missing frames will have been processed at the nominal rate.
+ * The expiry updates hw_ptr, which wakes up the waiters via
+ * snd_pcm_update_state() as usual; when the hardware is behind, the timer
+ * is re-armed for the remainder.
+ */
+#define TSCHED_MIN_NSEC		(100 * NSEC_PER_USEC)
+
+static snd_pcm_uframes_t tsched_target(struct snd_pcm_runtime *runtime)
+{
+	return runtime->twake ? runtime->twake : runtime->control->avail_min;
+}
+
+static ktime_t tsched_interval(struct snd_pcm_runtime *runtime,
+			       snd_pcm_uframes_t frames)
+{
+	u64 nsecs = div_u64((u64)frames * NSEC_PER_SEC, runtime->rate);
+
+	return ns_to_ktime(max_t(u64, nsecs, TSCHED_MIN_NSEC));
+}
+
+static enum hrtimer_restart snd_pcm_tsched_timer(struct hrtimer *timer)
+{
+	struct snd_pcm_substream *substream =
+		container_of(timer, struct snd_pcm_substream, tsched_timer);
+	struct snd_pcm_runtime *runtime;
+	enum hrtimer_restart ret = HRTIMER_NORESTART;
+	snd_pcm_uframes_t avail, target;
+	unsigned long flags;
+
+	snd_pcm_stream_lock_irqsave(substream, flags);
+	runtime = substream->runtime;
+	if (!runtime || !runtime->tsched ||
+	    runtime->status->state != SNDRV_PCM_STATE_RUNNING)
+		goto unlock;
+	if (snd_pcm_update_hw_ptr(substream) < 0 ||
+	    runtime->status->state != SNDRV_PCM_STATE_RUNNING)
+		goto unlock;
+
+	/* nobody to wake up any longer? */
+	if (!wq_has_sleeper(&runtime->sleep) &&
+	    !wq_has_sleeper(&runtime->tsleep))
+		goto unlock;
+	avail = snd_pcm_avail(substream);
+	target = tsched_target(runtime);
+	if (avail < target) {
+		hrtimer_forward_now(timer,
+				    tsched_interval(runtime, target - avail));
+		ret = HRTIMER_RESTART;
+	}
+ unlock:
+	snd_pcm_stream_unlock_irqrestore(substream, flags);
+	return ret;
+}
+
+void snd_pcm_tsched_init(struct snd_pcm_substream *substream)
+{
+	hrtimer_init(&substream->tsched_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL_SOFT);
+	substream->tsched_timer.function = snd_pcm_tsched_timer;
+}
+
+/* arm the wakeup timer for the current waiter; call with stream lock held */
+void snd_pcm_tsched_arm(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	snd_pcm_uframes_t avail, target;
+
+	if (!runtime->tsched ||
+	    runtime->status->state != SNDRV_PCM_STATE_RUNNING)
+		return;
+	avail = snd_pcm_avail(substream);
+	target = tsched_target(runtime);
+	if (avail >= target)
+		return;
+	hrtimer_start(&substream->tsched_timer,
+		      tsched_interval(runtime, target - avail),
+		      HRTIMER_MODE_REL_SOFT);
+}
+
 static void update_audio_tstamp(struct snd_pcm_substream *substream,
 				struct timespec64 *curr_tstamp,
 				struct timespec64 *audio_tstamp)
@@ -438,6 +523,11 @@ static int snd_pcm_update_hw_ptr0(struct snd_pcm_substream *substream,
 		return 0;
 	}
 
+	hdelta = new_hw_ptr - old_hw_ptr;
+	if (hdelta < 0)
+		hdelta += runtime->boundary;
+	snd_pcm_hist_add(substream, SNDRV_PCM_HIST_HWPTR_STEP, hdelta);
+
 	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK &&
 	    runtime->silence_size > 0)
 		snd_pcm_playback_silence(substream, new_hw_ptr);
@@ -1138,6 +1228,7 @@ int snd_pcm_hw_rule_add(struct snd_pcm_runtime *runtime, unsigned int cond,
 		constrs->rules = new;
 		constrs->rules_all = new_rules;
 	}
+	constrs->serial++;
 	c = &constrs->rules[constrs->rules_num];
 	c->cond = cond;
 	c->func = func;
@@ -1175,6 +1266,7 @@ int snd_pcm_hw_constraint_mask(struct snd_pcm_runtime *runtime, snd_pcm_hw_param
 {
 	struct snd_pcm_hw_constraints *constrs = &runtime->hw_constraints;
 	struct snd_mask *maskp = constrs_mask(constrs, var);
+	constrs->serial++;
 	*maskp->bits &= mask;
 	memset(maskp->bits + 1, 0, (SNDRV_MASK_MAX-32) / 8); /* clear rest */
 	if (*maskp->bits == 0)
@@ -1197,6 +1289,7 @@ int snd_pcm_hw_constraint_mask64(struct snd_pcm_runtime *runtime, snd_pcm_hw_par
 {
 	struct snd_pcm_hw_constraints *constrs = &runtime->hw_constraints;
 	struct snd_mask *maskp = constrs_mask(constrs, var);
+	constrs->serial++;
 	maskp->bits[0] &= (u_int32_t)mask;
 	maskp->bits[1] &= (u_int32_t)(mask >> 32);
 	memset(maskp->bits + 2, 0, (SNDRV_MASK_MAX-64) / 8); /* clear rest */
@@ -1219,6 +1312,7 @@ EXPORT_SYMBOL(snd_pcm_hw_constraint_mask64);
 int snd_pcm_hw_constraint_integer(struct snd_pcm_runtime *runtime, snd_pcm_hw_param_t var)
 {
 	struct snd_pcm_hw_constraints *constrs = &runtime->hw_constraints;
+	constrs->serial++;
 	return snd_interval_setinteger(constrs_interval(constrs, var));
 }
 EXPORT_SYMBOL(snd_pcm_hw_constraint_integer);
@@ -1244,6 +1338,7 @@ int snd_pcm_hw_constraint_minmax(struct snd_pcm_runtime *runtime, snd_pcm_hw_par
 	t.max = max;
 	t.openmin = t.openmax = 0;
 	t.integer = 0;
+	constrs->serial++;
 	return snd_interval_refine(constrs_interval(constrs, var), &t);
 }
 EXPORT_SYMBOL(snd_pcm_hw_constraint_minmax);
@@ -1777,6 +1872,31 @@ int snd_pcm_lib_ioctl(struct snd_pcm_substream *substream,
 }
 EXPORT_SYMBOL(snd_pcm_lib_ioctl);
 
+#ifdef CONFIG_SND_VERBOSE_PROCFS
+/* record the period interval deviation; call with the stream lock held */
+void snd_pcm_hist_period(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	u64 now, period_ns;
+	s64 diff;
+
+	if (!substream->hist)
+		return;
+	now = ktime_get_ns();
+	if (substream->hist_period_ns) {
+		period_ns = div_u64((u64)runtime->period_size * NSEC_PER_SEC,
+				    runtime->rate);
+		diff = now - substream->hist_period_ns - period_ns;
+		snd_pcm_hist_add(substream, SNDRV_PCM_HIST_PERIOD_JITTER,
+				 div_u64(abs(diff), NSEC_PER_USEC));
+	}
+	substream->hist_period_ns = now;
+	/* the waiter latency counts from the oldest unserved interrupt */
+	if (!substream->hist_irq_ns)
+		substream->hist_irq_ns = now;
+}
+#endif
+
 /**
  * snd_pcm_period_elapsed - update the pcm status for the next period
  * @substream: the pcm substream instance
@@ -1805,6 +1925,9 @@ void snd_pcm_period_elapsed(struct snd_pcm_substream *substream)
 	    snd_pcm_update_hw_ptr0(substream, 1) < 0)
 		goto _end;
 
+	snd_pcm_hist_period(substream);
+	snd_pcm_mix_period_elapsed(substream);
+
 #ifdef CONFIG_SND_PCM_TIMER
 	if (substream->timer_running)
 		snd_timer_interrupt(substream->timer, 1);
@@ -1870,11 +1993,13 @@ static int wait_for_avail(struct snd_pcm_substream *substream,
 		avail = snd_pcm_avail(substream);
 		if (avail >= runtime->twake)
 			break;
+		snd_pcm_tsched_arm(substream);
 		snd_pcm_stream_unlock_irq(substream);
 
 		tout = schedule_timeout(wait_time);
 
 		snd_pcm_stream_lock_irq(substream);
+		snd_pcm_hist_wakeup(substream);
 		set_current_state(TASK_INTERRUPTIBLE);
 		switch (runtime->status->state) {
 		case SNDRV_PCM_STATE_SUSPENDED:
@@ -2106,6 +2231,7 @@ int pcm_lib_apply_appl_ptr(struct snd_pcm_substream *substream,
 			return ret;
 		}
 	}
+	snd_pcm_hist_appl_ptr(substream);
 
 	trace_applptr(substream, old_appl_ptr, appl_ptr);
 
@@ -2258,6 +2384,169 @@ snd_pcm_sframes_t __snd_pcm_lib_xfer(struct snd_pcm_substream *substream,
 }
 EXPORT_SYMBOL(__snd_pcm_lib_xfer);
 
+/* copy the given frames from the user-space segments to the ring buffer
+ * at hwoff, split at both the segment and the ring buffer boundaries;
+ * *seg and *seg_ofs keep the current position in the vector
+ */
+static int iov_write_copy(struct snd_pcm_substream *substream,
+			  snd_pcm_uframes_t hwoff,
+			  const struct snd_xferi_iov *iov,
+			  unsigned long *seg, snd_pcm_uframes_t *seg_ofs,
+			  snd_pcm_uframes_t frames, pcm_transfer_f transfer)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	snd_pcm_uframes_t n;
+	int err;
+
+	while (frames > 0) {
+		const struct snd_xferi_iov *v = &iov[*seg];
+
+		n = min3(frames, v->frames - *seg_ofs,
+			 runtime->buffer_size - hwoff);
+		if (n) {
+			err = interleaved_copy(substream, hwoff,
+					       (void __force *)v->buf,
+					       *seg_ofs, n, transfer);
+			if (err < 0)
+				return err;
+		}
+		frames -= n;
+		hwoff += n;
+		if (hwoff >= runtime->buffer_size)
+			hwoff = 0;
+		*seg_ofs += n;
+		if (*seg_ofs >= v->frames) {
+			(*seg)++;
+			*seg_ofs = 0;
+		}
+	}
+	return 0;
+}
+
+/**
+ * snd_pcm_lib_write_iov - write interleaved frames from a buffer vector
+ * @substream: the PCM substream
+ * @iov: the array of user-space segments
+ * @nr_segs: the number of segments in @iov
+ *
+ * Like snd_pcm_lib_write(), but gathers the frames from several user-space
+ * buffers.  All frames fitting into the available space are copied with a
+ * single unlock/lock of the stream, and the appl_ptr is committed (and the
+ * ack callback is invoked) only once per such batch instead of once per
+ * contiguous chunk.
+ *
+ * Return: the number of written frames, or a negative error code.
+ */
+snd_pcm_sframes_t snd_pcm_lib_write_iov(struct snd_pcm_substream *substream,
+					const struct snd_xferi_iov *iov,
+					unsigned long nr_segs)
+{
+	struct snd_pcm_runtime *runtime;
+	snd_pcm_uframes_t xfer = 0;
+	snd_pcm_uframes_t size = 0;
+	snd_pcm_uframes_t seg_ofs = 0;
+	snd_pcm_uframes_t avail;
+	unsigned long seg = 0;
+	unsigned long i;
+	pcm_transfer_f transfer;
+	bool nonblock;
+	int err;
+
+	err = pcm_sanity_check(substream);
+	if (err < 0)
+		return err;
+	runtime = substream->runtime;
+
+	if (substream->stream != SNDRV_PCM_STREAM_PLAYBACK)
+		return -EINVAL;
+	if (runtime->access != SNDRV_PCM_ACCESS_RW_INTERLEAVED &&
+	    runtime->channels > 1)
+		return -EINVAL;
+
+	for (i = 0; i < nr_segs; i++) {
+		if (iov[i].frames > runtime->boundary - size)
+			return -EINVAL;
+		size += iov[i].frames;
+	}
+	if (size == 0)
+		return 0;
+
+	if (substream->ops->copy_user)
+		transfer = (pcm_transfer_f)substream->ops->copy_user;
+	else
+		transfer = default_write_copy;
+
+	nonblock = !!(substream->f_flags & O_NONBLOCK);
+
+	snd_pcm_stream_lock_irq(substream);
+	err = pcm_accessible_state(runtime);
+	if (err < 0)
+		goto _end_unlock;
+
+	runtime->twake = runtime->control->avail_min ? : 1;
+	if (runtime->status->state == SNDRV_PCM_STATE_RUNNING)
+		snd_pcm_update_hw_ptr(substream);
+
+	avail = snd_pcm_avail(substream);
+
+	while (size > 0) {
+		snd_pcm_uframes_t frames, appl_ptr;
+
+		if (!avail) {
+			if (nonblock) {
+				err = -EAGAIN;
+				goto _end_unlock;
+			}
+			runtime->twake = min_t(snd_pcm_uframes_t, size,
+					runtime->control->avail_min ? : 1);
+			err = wait_for_avail(substream, &avail);
+			if (err < 0)
+				goto _end_unlock;
+			if (!avail)
+				continue;
+		}
+		/* unlike __snd_pcm_lib_xfer(), wrap around the ring buffer
+		 * and cross the segments in one go
+		 */
+		frames = size > avail ? avail : size;
+		if (frames > runtime->buffer_size)
+			frames = runtime->buffer_size;
+		appl_ptr = READ_ONCE(runtime->control->appl_ptr);
+		snd_pcm_stream_unlock_irq(substream);
+		err = iov_write_copy(substream, appl_ptr % runtime->buffer_size,
+				     iov, &seg, &seg_ofs, frames, transfer);
+		snd_pcm_stream_lock_irq(substream);
+		if (err < 0)
+			goto _end_unlock;
+		err = pcm_accessible_state(runtime);
+		if (err < 0)
+			goto _end_unlock;
+		appl_ptr += frames;
+		if (appl_ptr >= runtime->boundary)
+			appl_ptr -= runtime->boundary;
+		err = pcm_lib_apply_appl_ptr(substream, appl_ptr);
+		if (err < 0)
+			goto _end_unlock;
+
+		size -= frames;
+		xfer += frames;
+		avail -= frames;
+		if (runtime->status->state == SNDRV_PCM_STATE_PREPARED &&
+		    snd_pcm_playback_hw_avail(runtime) >= (snd_pcm_sframes_t)runtime->start_threshold) {
+			err = snd_pcm_start(substream);
+			if (err < 0)
+				goto _end_unlock;
+		}
+	}
+ _end_unlock:
+	runtime->twake = 0;
+	if (xfer > 0 && err >= 0)
+		snd_pcm_update_state(substream, runtime);
+	snd_pcm_stream_unlock_irq(substream);
+	return xfer > 0 ? (snd_pcm_sframes_t)xfer : err;
+}
+EXPORT_SYMBOL(snd_pcm_lib_write_iov);
+
 /*
  * standard channel mapping helpers
  */
@@ -32,6 +32,91 @@ int snd_pcm_update_hw_ptr(struct snd_pcm_substream *substream);
 void snd_pcm_playback_silence(struct snd_pcm_substream *substream,
 			      snd_pcm_uframes_t new_hw_ptr);
 
+#ifdef CONFIG_SND_PROC_FS
+struct snd_info_buffer;
+void snd_pcm_pool_proc_read(struct snd_info_entry *entry,
+			    struct snd_info_buffer *buffer);
+#endif
+
+void snd_pcm_tsched_init(struct snd_pcm_substream *substream);
+void snd_pcm_tsched_arm(struct snd_pcm_substream *substream);
+
+/*
+ * Per-substream timing histograms in /proc/asound/cardX/pcmYZ/subN/timing.
+ * Bucket n counts values in [2^(n-1), 2^n), bucket 0 counts zero and the
+ * last bucket everything above; times are in microseconds.
+ */
+enum {
+	SNDRV_PCM_HIST_PERIOD_JITTER,	/* period IRQ interval deviation */
+	SNDRV_PCM_HIST_HWPTR_STEP,	/* hw_ptr advance in frames */
+	SNDRV_PCM_HIST_IRQ_WAKE,	/* period IRQ to waiter running */
+	SNDRV_PCM_HIST_WAKE_APPL,	/* waiter running to appl_ptr update */
+	SNDRV_PCM_HIST_NUM
+};
+
+#define SNDRV_PCM_HIST_BUCKETS	16
+
+struct snd_pcm_hist {
+	unsigned long count[SNDRV_PCM_HIST_NUM][SNDRV_PCM_HIST_BUCKETS];
+};
+
+#ifdef CONFIG_SND_VERBOSE_PROCFS
+static inline void snd_pcm_hist_add(struct snd_pcm_substream *substream,
+				    int type, u64 val)
+{
+	if (substream->hist)
+		this_cpu_inc(substream->hist->count[type]
+			     [min_t(int, fls64(val), SNDRV_PCM_HIST_BUCKETS - 1)]);
+}
+
+/* the following are called with the stream lock held */
+static inline void snd_pcm_hist_start(struct snd_pcm_substream *substream)
+{
+	substream->hist_period_ns = 0;
+	substream->hist_irq_ns = 0;
+	substream->hist_wake_ns = 0;
+}
+
+void snd_pcm_hist_period(struct snd_pcm_substream *substream);
+
+static inline void snd_pcm_hist_wakeup(struct snd_pcm_substream *substream)
+{
+	u64 now;
+
+	if (!substream->hist || !substream->hist_irq_ns)
+		return;
+	now = ktime_get_ns();
+	snd_pcm_hist_add(substream, SNDRV_PCM_HIST_IRQ_WAKE,
+			 div_u64(now - substream->hist_irq_ns, NSEC_PER_USEC));
+	substream->hist_irq_ns = 0;
+	substream->hist_wake_ns = now;
+}
+
+static inline void snd_pcm_hist_appl_ptr(struct snd_pcm_substream *substream)
+{
+	if (!substream->hist || !substream->hist_wake_ns)
+		return;
+	snd_pcm_hist_add(substream, SNDRV_PCM_HIST_WAKE_APPL,
+			 div_u64(ktime_get_ns() - substream->hist_wake_ns,
+				 NSEC_PER_USEC));
+	substream->hist_wake_ns = 0;
+}
+#else
+static inline void snd_pcm_hist_add(struct snd_pcm_substream *substream,
+				    int type, u64 val) {}
+static inline void snd_pcm_hist_start(struct snd_pcm_substream *substream) {}
+static inline void snd_pcm_hist_period(struct snd_pcm_substream *substream) {}
+static inline void snd_pcm_hist_wakeup(struct snd_pcm_substream *substream) {}
+static inline void snd_pcm_hist_appl_ptr(struct snd_pcm_substream *substream) {}
+#endif
+
+#ifdef CONFIG_SND_PCM_MIX
+void snd_pcm_mix_period_elapsed(struct snd_pcm_substream *substream);
+#else
+static inline void
+snd_pcm_mix_period_elapsed(struct snd_pcm_substream *substream) {}
+#endif
+
 static inline snd_pcm_uframes_t
 snd_pcm_avail(struct snd_pcm_substream *substream)
 {
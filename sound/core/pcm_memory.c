@@ -11,6 +11,7 @@
 #include <linux/moduleparam.h>
 #include <linux/vmalloc.h>
 #include <linux/export.h>
+#include <linux/log2.h>
 #include <sound/core.h>
 #include <sound/pcm.h>
 #include <sound/info.h>
@@ -31,6 +32,14 @@ static unsigned long max_alloc_per_card = 32UL * 1024UL * 1024UL;
 module_param(max_alloc_per_card, ulong, 0644);
 MODULE_PARM_DESC(max_alloc_per_card, "Max total allocation bytes per card.");
 
+static unsigned long max_pool_bytes = 4UL * 1024UL * 1024UL;
+module_param(max_pool_bytes, ulong, 0644);
+MODULE_PARM_DESC(max_pool_bytes, "Max total bytes of released buffers kept for reuse.");
+
+static unsigned int pool_reserve;
+module_param(pool_reserve, uint, 0444);
+MODULE_PARM_DESC(pool_reserve, "Buffers to reserve in the pool for each managed substream without preallocation.");
+
 static int do_alloc_pages(struct snd_card *card, int type, struct device *dev,
 			  size_t size, struct snd_dma_buffer *dmab)
 {
@@ -61,6 +70,174 @@ static void do_free_pages(struct snd_card *card, struct snd_dma_buffer *dmab)
 	dmab->area = NULL;
 }
 
+/*
+ * Pool of released contiguous buffers
+ *
+ * Buffers allocated by snd_pcm_lib_malloc_pages() are rounded up to a power
+ * of two and given to the pool instead of being freed at hw_free, so that
+ * the next hw_params of a stream on the same device finds one without
+ * having to get contiguous memory again.  The buffers stay accounted to
+ * their card and are released when any PCM of the card is freed.
+ */
+struct pcm_pool_entry {
+	struct list_head list;
+	struct snd_card *card;
+	struct snd_dma_buffer dmab;
+};
+
+static LIST_HEAD(pool_list);
+static DEFINE_MUTEX(pool_mutex);
+static size_t pool_bytes;
+static unsigned int pool_buffers;
+static unsigned long pool_hits, pool_misses, pool_returned, pool_dropped;
+
+static bool pool_type_supported(int type)
+{
+	switch (type) {
+	case SNDRV_DMA_TYPE_CONTINUOUS:
+	case SNDRV_DMA_TYPE_DEV:
+	case SNDRV_DMA_TYPE_DEV_UC:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static size_t pool_size_class(size_t size)
+{
+	return roundup_pow_of_two(PAGE_ALIGN(size));
+}
+
+/* take a buffer of the given size class from the pool */
+static bool pool_get(struct snd_card *card, struct snd_dma_buffer *dmab,
+		     size_t size)
+{
+	struct pcm_pool_entry *entry;
+	bool found = false;
+
+	mutex_lock(&pool_mutex);
+	list_for_each_entry(entry, &pool_list, list) {
+		if (entry->card == card &&
+		    entry->dmab.dev.type == dmab->dev.type &&
+		    entry->dmab.dev.dev == dmab->dev.dev &&
+		    entry->dmab.bytes == size) {
+			list_del(&entry->list);
+			pool_bytes -= size;
+			pool_buffers--;
+			*dmab = entry->dmab;
+			kfree(entry);
+			found = true;
+			break;
+		}
+	}
+	if (found)
+		pool_hits++;
+	else
+		pool_misses++;
+	mutex_unlock(&pool_mutex);
+
+	/* don't hand out what the previous user left behind */
+	if (found)
+		memset(dmab->area, 0, dmab->bytes);
+	return found;
+}
+
+/* give a buffer to the pool, or release it if the pool doesn't want it */
+static void pool_put(struct snd_card *card, struct snd_dma_buffer *dmab)
+{
+	struct pcm_pool_entry *entry;
+
+	if (!dmab->area)
+		return;
+
+	mutex_lock(&pool_mutex);
+	if (!pool_type_supported(dmab->dev.type) ||
+	    !is_power_of_2(dmab->bytes) ||
+	    pool_bytes + dmab->bytes > max_pool_bytes)
+		goto drop;
+	entry = kmalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry)
+		goto drop;
+	entry->card = card;
+	entry->dmab = *dmab;
+	list_add(&entry->list, &pool_list);
+	pool_bytes += dmab->bytes;
+	pool_buffers++;
+	pool_returned++;
+	mutex_unlock(&pool_mutex);
+	dmab->area = NULL;
+	return;
+
+ drop:
+	pool_dropped++;
+	mutex_unlock(&pool_mutex);
+	do_free_pages(card, dmab);
+}
+
+/* release all pooled buffers of the card */
+static void pool_drain(struct snd_card *card)
+{
+	struct pcm_pool_entry *entry, *next;
+
+	mutex_lock(&pool_mutex);
+	list_for_each_entry_safe(entry, next, &pool_list, list) {
+		if (entry->card != card)
+			continue;
+		list_del(&entry->list);
+		pool_bytes -= entry->dmab.bytes;
+		pool_buffers--;
+		do_free_pages(card, &entry->dmab);
+		kfree(entry);
+	}
+	mutex_unlock(&pool_mutex);
+}
+
+/* fill the pool for a substream that got no preallocated buffer */
+static void pool_reserve_pages(struct snd_pcm_substream *substream,
+			       size_t size)
+{
+	struct snd_card *card = substream->pcm->card;
+	struct snd_dma_buffer dmab;
+	unsigned int i;
+
+	if (!pool_type_supported(substream->dma_buffer.dev.type))
+		return;
+
+	size = pool_size_class(size);
+	for (i = 0; i < pool_reserve; i++) {
+		memset(&dmab, 0, sizeof(dmab));
+		if (do_alloc_pages(card, substream->dma_buffer.dev.type,
+				   substream->dma_buffer.dev.dev, size, &dmab) < 0)
+			break;
+		pool_put(card, &dmab);
+	}
+}
+
+#ifdef CONFIG_SND_PROC_FS
+void snd_pcm_pool_proc_read(struct snd_info_entry *entry,
+			    struct snd_info_buffer *buffer)
+{
+	struct pcm_pool_entry *p;
+	unsigned int counts[BITS_PER_LONG] = {};
+	int i;
+
+	mutex_lock(&pool_mutex);
+	snd_iprintf(buffer, "buffers  : %u (%zu kB, max %lu kB)\n",
+		    pool_buffers, pool_bytes / 1024, max_pool_bytes / 1024);
+	snd_iprintf(buffer, "hits     : %lu\n", pool_hits);
+	snd_iprintf(buffer, "misses   : %lu\n", pool_misses);
+	snd_iprintf(buffer, "returned : %lu\n", pool_returned);
+	snd_iprintf(buffer, "dropped  : %lu\n", pool_dropped);
+	list_for_each_entry(p, &pool_list, list)
+		counts[ilog2(p->dmab.bytes)]++;
+	for (i = 0; i < BITS_PER_LONG; i++)
+		if (counts[i])
+			snd_iprintf(buffer, "%8lu kB : %u\n",
+				    (1UL << i) / 1024, counts[i]);
+	mutex_unlock(&pool_mutex);
+}
+#endif
+
 /*
  * try to allocate as the large pages as possible.
  * stores the resultant memory size in *res_size.
@@ -122,6 +299,8 @@ void snd_pcm_lib_preallocate_free_for_all(struct snd_pcm *pcm)
 	for (stream = 0; stream < 2; stream++)
 		for (substream = pcm->streams[stream].substream; substream; substream = substream->next)
 			snd_pcm_lib_preallocate_free(substream);
+	/* the pool may hold buffers of this PCM's devices */
+	pool_drain(pcm->card);
 }
 EXPORT_SYMBOL(snd_pcm_lib_preallocate_free_for_all);
 
@@ -240,6 +419,8 @@ static void preallocate_pages(struct snd_pcm_substream *substream,
 
 	if (substream->dma_buffer.bytes > 0)
 		substream->buffer_bytes_max = substream->dma_buffer.bytes;
+	else if (managed && size > 0)
+		pool_reserve_pages(substream, size);
 	substream->dma_max = max;
 	if (max > 0)
 		preallocate_info_init(substream);
@@ -407,6 +588,16 @@ int snd_pcm_lib_malloc_pages(struct snd_pcm_substream *substream, size_t size)
 		if (! dmab)
 			return -ENOMEM;
 		dmab->dev = substream->dma_buffer.dev;
+		if (max_pool_bytes && pool_type_supported(dmab->dev.type)) {
+			/* a rounded up size makes the buffer reusable */
+			if (pool_get(card, dmab, pool_size_class(size)))
+				goto allocated;
+			if (!do_alloc_pages(card,
+					    substream->dma_buffer.dev.type,
+					    substream->dma_buffer.dev.dev,
+					    pool_size_class(size), dmab))
+				goto allocated;
+		}
 		if (do_alloc_pages(card,
 				   substream->dma_buffer.dev.type,
 				   substream->dma_buffer.dev.dev,
@@ -415,6 +606,7 @@ int snd_pcm_lib_malloc_pages(struct snd_pcm_substream *substream, size_t size)
 			return -ENOMEM;
 		}
 	}
+ allocated:
 	snd_pcm_set_runtime_buffer(substream, dmab);
 	runtime->dma_bytes = size;
 	return 1;			/* area was changed */
@@ -440,8 +632,8 @@ int snd_pcm_lib_free_pages(struct snd_pcm_substream *substream)
 	if (runtime->dma_area == NULL)
 		return 0;
 	if (runtime->dma_buffer_p != &substream->dma_buffer) {
-		/* it's a newly allocated buffer.  release it now. */
-		do_free_pages(card, runtime->dma_buffer_p);
+		/* it's a newly allocated buffer.  recycle or release it now. */
+		pool_put(card, runtime->dma_buffer_p);
 		kfree(runtime->dma_buffer_p);
 	}
 	snd_pcm_set_runtime_buffer(substream, NULL);
@@ -0,0 +1,487 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *  Mixing of several playback substreams into one hardware substream
+ *
+ *  The voices are ordinary playback substreams of a virtual PCM with
+ *  vmalloc'ed buffers.  The hardware substream lives on an internal PCM
+ *  that carries the driver's ops and is opened in-kernel while any voice
+ *  is open.  Whenever the hardware reports a period or a voice starts,
+ *  the running voices are summed period by period with saturation into its free space, and
+ *  each mixed voice gets its own period elapsed notification.
+ */
+
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/export.h>
+#include <sound/core.h>
+#include <sound/pcm.h>
+#include <sound/pcm_params.h>
+#include <sound/pcm_mix.h>
+#include "pcm_local.h"
+
+#define SNDRV_PCM_MIX_PERIODS_MAX	64	/* of a voice buffer */
+
+struct snd_pcm_mix_voice {
+	struct snd_pcm_substream *substream;
+	snd_pcm_uframes_t pos;	/* next frame to mix */
+	bool running;
+	bool elapsed;		/* a period was mixed, not notified yet */
+};
+
+struct snd_pcm_mix {
+	struct snd_pcm *pcm;		/* the voices */
+	struct snd_pcm *hw_pcm;		/* the hardware */
+	struct snd_pcm_substream *hw;	/* opened hardware substream */
+	struct snd_pcm_mix_config config;
+	unsigned int samples;		/* samples in a period */
+	void *acc;			/* s32 or s64 sums of a period */
+	void *out;			/* mixed period */
+	struct mutex lock;		/* protects hw against the work */
+	int users;
+	struct work_struct work;
+	int num_voices;
+	struct snd_pcm_mix_voice voices[];
+};
+
+/*
+ * plain scalar loops over contiguous samples; kernel code is built
+ * without FPU/SIMD registers, so no vector instructions are used here
+ */
+static void mix_add_s16(s32 *acc, const s16 *src, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		acc[i] += src[i];
+}
+
+static void mix_out_s16(s16 *dst, const s32 *acc, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = clamp_t(s32, acc[i], S16_MIN, S16_MAX);
+}
+
+static void mix_add_s32(s64 *acc, const s32 *src, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		acc[i] += src[i];
+}
+
+static void mix_out_s32(s32 *dst, const s64 *acc, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = clamp_t(s64, acc[i], S32_MIN, S32_MAX);
+}
+
+/* sum one period of all running voices into mix->out */
+static void mix_period(struct snd_pcm_mix *mix)
+{
+	bool is_s16 = mix->config.format == SNDRV_PCM_FORMAT_S16_LE;
+	struct snd_pcm_mix_voice *voice;
+	struct snd_pcm_substream *substream;
+	struct snd_pcm_runtime *runtime;
+	void *src;
+	int i;
+
+	memset(mix->acc, 0, mix->samples * (is_s16 ? sizeof(s32) : sizeof(s64)));
+	for (i = 0; i < mix->num_voices; i++) {
+		voice = &mix->voices[i];
+		substream = voice->substream;
+		snd_pcm_stream_lock_irq(substream);
+		if (voice->running) {
+			runtime = substream->runtime;
+			src = runtime->dma_area +
+				frames_to_bytes(runtime, voice->pos);
+			if (is_s16)
+				mix_add_s16(mix->acc, src, mix->samples);
+			else
+				mix_add_s32(mix->acc, src, mix->samples);
+			voice->pos += mix->config.period_size;
+			if (voice->pos >= runtime->buffer_size)
+				voice->pos = 0;
+			voice->elapsed = true;
+		}
+		snd_pcm_stream_unlock_irq(substream);
+	}
+
+	if (is_s16)
+		mix_out_s16(mix->out, mix->acc, mix->samples);
+	else
+		mix_out_s32(mix->out, mix->acc, mix->samples);
+}
+
+/* fill the free space of the hardware buffer, then notify the voices */
+static void snd_pcm_mix_work(struct work_struct *work)
+{
+	struct snd_pcm_mix *mix = container_of(work, struct snd_pcm_mix, work);
+	struct snd_pcm_substream *substream;
+	snd_pcm_uframes_t avail;
+	snd_pcm_state_t state;
+	bool elapsed;
+	int i;
+
+	mutex_lock(&mix->lock);
+	substream = mix->hw;
+	while (substream) {
+		snd_pcm_stream_lock_irq(substream);
+		state = substream->runtime->status->state;
+		avail = snd_pcm_playback_avail(substream->runtime);
+		snd_pcm_stream_unlock_irq(substream);
+
+		if (state == SNDRV_PCM_STATE_XRUN ||
+		    state == SNDRV_PCM_STATE_SUSPENDED) {
+			if (snd_pcm_kernel_ioctl(substream,
+						 SNDRV_PCM_IOCTL_PREPARE, NULL))
+				break;
+			continue;
+		}
+		if (avail < mix->config.period_size)
+			break;
+		mix_period(mix);
+		if (snd_pcm_kernel_write(substream, mix->out,
+					 mix->config.period_size) < 0)
+			break;
+	}
+	mutex_unlock(&mix->lock);
+
+	for (i = 0; i < mix->num_voices; i++) {
+		substream = mix->voices[i].substream;
+		snd_pcm_stream_lock_irq(substream);
+		elapsed = mix->voices[i].elapsed;
+		mix->voices[i].elapsed = false;
+		snd_pcm_stream_unlock_irq(substream);
+		if (elapsed)
+			snd_pcm_period_elapsed(substream);
+	}
+}
+
+/* called from snd_pcm_period_elapsed() of the hardware substream */
+void snd_pcm_mix_period_elapsed(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_mix *mix = READ_ONCE(substream->mix);
+
+	if (mix)
+		queue_work(system_highpri_wq, &mix->work);
+}
+
+static void mix_param_set_mask(struct snd_pcm_hw_params *params,
+			       snd_pcm_hw_param_t var, unsigned int val)
+{
+	struct snd_mask *mask = hw_param_mask(params, var);
+
+	snd_mask_none(mask);
+	snd_mask_set(mask, val);
+}
+
+static void mix_param_set_int(struct snd_pcm_hw_params *params,
+			      snd_pcm_hw_param_t var, unsigned int val)
+{
+	struct snd_interval *i = hw_param_interval(params, var);
+
+	i->min = i->max = val;
+	i->openmin = i->openmax = 0;
+	i->integer = 1;
+	i->empty = 0;
+}
+
+/* open and start the hardware substream; call with mix->lock held */
+static int mix_hw_open(struct snd_pcm_mix *mix)
+{
+	const struct snd_pcm_mix_config *config = &mix->config;
+	struct snd_pcm_substream *substream;
+	struct snd_pcm_hw_params *params;
+	struct snd_pcm_sw_params sw_params;
+	int err;
+
+	err = snd_pcm_open_substream(mix->hw_pcm, SNDRV_PCM_STREAM_PLAYBACK,
+				     NULL, &substream);
+	if (err < 0)
+		return err;
+
+	params = kmalloc(sizeof(*params), GFP_KERNEL);
+	if (!params) {
+		err = -ENOMEM;
+		goto error;
+	}
+	_snd_pcm_hw_params_any(params);
+	mix_param_set_mask(params, SNDRV_PCM_HW_PARAM_ACCESS,
+			   SNDRV_PCM_ACCESS_RW_INTERLEAVED);
+	mix_param_set_mask(params, SNDRV_PCM_HW_PARAM_FORMAT,
+			   (__force unsigned int)config->format);
+	mix_param_set_int(params, SNDRV_PCM_HW_PARAM_RATE, config->rate);
+	mix_param_set_int(params, SNDRV_PCM_HW_PARAM_CHANNELS,
+			  config->channels);
+	mix_param_set_int(params, SNDRV_PCM_HW_PARAM_PERIOD_SIZE,
+			  config->period_size);
+	mix_param_set_int(params, SNDRV_PCM_HW_PARAM_PERIODS, config->periods);
+	err = snd_pcm_kernel_ioctl(substream, SNDRV_PCM_IOCTL_HW_PARAMS,
+				   params);
+	kfree(params);
+	if (err < 0) {
+		pcm_err(mix->pcm, "mix: hardware rejects the configuration\n");
+		goto error;
+	}
+
+	/* start once the whole buffer is mixed ahead */
+	memset(&sw_params, 0, sizeof(sw_params));
+	sw_params.tstamp_mode = SNDRV_PCM_TSTAMP_NONE;
+	sw_params.period_step = 1;
+	sw_params.avail_min = config->period_size;
+	sw_params.start_threshold = substream->runtime->buffer_size;
+	sw_params.stop_threshold = substream->runtime->buffer_size;
+	sw_params.boundary = substream->runtime->boundary;
+	err = snd_pcm_kernel_ioctl(substream, SNDRV_PCM_IOCTL_SW_PARAMS,
+				   &sw_params);
+	if (err < 0)
+		goto error;
+	err = snd_pcm_kernel_ioctl(substream, SNDRV_PCM_IOCTL_PREPARE, NULL);
+	if (err < 0)
+		goto error;
+
+	/* the work must never sleep for room */
+	substream->f_flags |= O_NONBLOCK;
+	mix->hw = substream;
+	snd_pcm_stream_lock_irq(substream);
+	WRITE_ONCE(substream->mix, mix);
+	snd_pcm_stream_unlock_irq(substream);
+	queue_work(system_highpri_wq, &mix->work);
+	return 0;
+
+ error:
+	snd_pcm_release_substream(substream);
+	return err;
+}
+
+/* voices are opened and closed under pcm->open_mutex */
+static int snd_pcm_mix_open(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_mix *mix = snd_pcm_substream_chip(substream);
+	struct snd_pcm_mix_voice *voice = &mix->voices[substream->number];
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	size_t period_bytes;
+	int err;
+
+	period_bytes = mix->config.period_size *
+		snd_pcm_format_physical_width(mix->config.format) / 8 *
+		mix->config.channels;
+	runtime->hw.info = SNDRV_PCM_INFO_MMAP | SNDRV_PCM_INFO_MMAP_VALID |
+			   SNDRV_PCM_INFO_INTERLEAVED |
+			   SNDRV_PCM_INFO_BLOCK_TRANSFER;
+	runtime->hw.formats = pcm_format_to_bits(mix->config.format);
+	runtime->hw.rates = SNDRV_PCM_RATE_CONTINUOUS;
+	runtime->hw.rate_min = runtime->hw.rate_max = mix->config.rate;
+	runtime->hw.channels_min = mix->config.channels;
+	runtime->hw.channels_max = mix->config.channels;
+	runtime->hw.period_bytes_min = runtime->hw.period_bytes_max =
+		period_bytes;
+	runtime->hw.periods_min = 2;
+	runtime->hw.periods_max = SNDRV_PCM_MIX_PERIODS_MAX;
+	runtime->hw.buffer_bytes_max = period_bytes * SNDRV_PCM_MIX_PERIODS_MAX;
+	err = snd_pcm_hw_constraint_integer(runtime,
+					    SNDRV_PCM_HW_PARAM_PERIODS);
+	if (err < 0)
+		return err;
+
+	mutex_lock(&mix->lock);
+	if (!mix->users)
+		err = mix_hw_open(mix);
+	if (!err)
+		mix->users++;
+	mutex_unlock(&mix->lock);
+	if (err < 0)
+		return err;
+
+	voice->pos = 0;
+	voice->running = false;
+	return 0;
+}
+
+static int snd_pcm_mix_close(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_mix *mix = snd_pcm_substream_chip(substream);
+	struct snd_pcm_substream *hw = NULL;
+
+	mutex_lock(&mix->lock);
+	if (!--mix->users) {
+		hw = mix->hw;
+		mix->hw = NULL;
+		snd_pcm_stream_lock_irq(hw);
+		WRITE_ONCE(hw->mix, NULL);
+		snd_pcm_stream_unlock_irq(hw);
+	}
+	mutex_unlock(&mix->lock);
+
+	if (hw) {
+		cancel_work_sync(&mix->work);
+		snd_pcm_release_substream(hw);
+	} else {
+		/* the work may still be notifying this voice */
+		flush_work(&mix->work);
+	}
+	return 0;
+}
+
+static int snd_pcm_mix_prepare(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_mix *mix = snd_pcm_substream_chip(substream);
+	struct snd_pcm_mix_voice *voice = &mix->voices[substream->number];
+
+	/* called with the stream lock held */
+	voice->pos = 0;
+	voice->elapsed = false;
+	return 0;
+}
+
+static int snd_pcm_mix_trigger(struct snd_pcm_substream *substream, int cmd)
+{
+	struct snd_pcm_mix *mix = snd_pcm_substream_chip(substream);
+	struct snd_pcm_mix_voice *voice = &mix->voices[substream->number];
+
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+	case SNDRV_PCM_TRIGGER_RESUME:
+	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
+		voice->running = true;
+		/* also recovers the hardware from an xrun or a suspend */
+		queue_work(system_highpri_wq, &mix->work);
+		break;
+	case SNDRV_PCM_TRIGGER_STOP:
+	case SNDRV_PCM_TRIGGER_SUSPEND:
+	case SNDRV_PCM_TRIGGER_PAUSE_PUSH:
+		voice->running = false;
+		voice->elapsed = false;
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* wait for the work that may still notify a stopped voice */
+static int snd_pcm_mix_sync_stop(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_mix *mix = snd_pcm_substream_chip(substream);
+
+	flush_work(&mix->work);
+	return 0;
+}
+
+static snd_pcm_uframes_t snd_pcm_mix_pointer(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_mix *mix = snd_pcm_substream_chip(substream);
+
+	return mix->voices[substream->number].pos;
+}
+
+static const struct snd_pcm_ops snd_pcm_mix_ops = {
+	.open =		snd_pcm_mix_open,
+	.close =	snd_pcm_mix_close,
+	.prepare =	snd_pcm_mix_prepare,
+	.trigger =	snd_pcm_mix_trigger,
+	.sync_stop =	snd_pcm_mix_sync_stop,
+	.pointer =	snd_pcm_mix_pointer,
+};
+
+static void snd_pcm_mix_free(struct snd_pcm *pcm)
+{
+	struct snd_pcm_mix *mix = pcm->private_data;
+
+	kfree(mix->acc);
+	kfree(mix->out);
+	kfree(mix);
+}
+
+/**
+ * snd_pcm_mix_new - create a PCM mixing several voices into one substream
+ * @card: the card instance
+ * @id: the id string
+ * @device: the device index of the virtual PCM
+ * @voices: the number of playback substreams of the virtual PCM
+ * @config: the fixed setup of the hardware substream
+ * @rpcm: the pointer to store the virtual PCM
+ * @rhw_pcm: the pointer to store the internal hardware PCM
+ *
+ * Creates a virtual PCM with @voices playback substreams, whose data is
+ * summed with saturation into the single playback substream of an
+ * internal PCM.  The driver sets its ops, private_data and buffer
+ * allocation on *@rhw_pcm just as for a normal PCM and calls
+ * snd_pcm_period_elapsed() on it; the voices all share @config.
+ *
+ * Return: Zero if successful, or a negative error code on failure.
+ */
+int snd_pcm_mix_new(struct snd_card *card, const char *id, int device,
+		    int voices, const struct snd_pcm_mix_config *config,
+		    struct snd_pcm **rpcm, struct snd_pcm **rhw_pcm)
+{
+	struct snd_pcm_substream *substream;
+	struct snd_pcm_mix *mix;
+	struct snd_pcm *pcm, *hw_pcm;
+	size_t acc_size;
+	int err;
+
+	if (config->format != SNDRV_PCM_FORMAT_S16_LE &&
+	    config->format != SNDRV_PCM_FORMAT_S32_LE)
+		return -EINVAL;
+	if (!config->period_size || config->periods < 2 ||
+	    !config->channels || !config->rate || voices < 1)
+		return -EINVAL;
+
+	mix = kzalloc(struct_size(mix, voices, voices), GFP_KERNEL);
+	if (!mix)
+		return -ENOMEM;
+	mix->config = *config;
+	mix->num_voices = voices;
+	mix->samples = config->period_size * config->channels;
+	mutex_init(&mix->lock);
+	INIT_WORK(&mix->work, snd_pcm_mix_work);
+
+	acc_size = config->format == SNDRV_PCM_FORMAT_S16_LE ?
+		sizeof(s32) : sizeof(s64);
+	mix->acc = kmalloc_array(mix->samples, acc_size, GFP_KERNEL);
+	mix->out = kmalloc_array(mix->samples,
+				 snd_pcm_format_physical_width(config->format) / 8,
+				 GFP_KERNEL);
+	if (!mix->acc || !mix->out) {
+		err = -ENOMEM;
+		goto error;
+	}
+
+	err = snd_pcm_new_internal(card, id, device, 1, 0, &hw_pcm);
+	if (err < 0)
+		goto error;
+	err = snd_pcm_new(card, id, device, voices, 0, &pcm);
+	if (err < 0) {
+		snd_device_free(card, hw_pcm);
+		goto error;
+	}
+
+	mix->pcm = pcm;
+	mix->hw_pcm = hw_pcm;
+	pcm->private_data = mix;
+	pcm->private_free = snd_pcm_mix_free;
+	strscpy(pcm->name, id, sizeof(pcm->name));
+	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_PLAYBACK, &snd_pcm_mix_ops);
+	snd_pcm_set_managed_buffer_all(pcm, SNDRV_DMA_TYPE_VMALLOC,
+				       NULL, 0, 0);
+
+	substream = pcm->streams[SNDRV_PCM_STREAM_PLAYBACK].substream;
+	for (; substream; substream = substream->next)
+		mix->voices[substream->number].substream = substream;
+
+	*rpcm = pcm;
+	*rhw_pcm = hw_pcm;
+	return 0;
+
+ error:
+	kfree(mix->acc);
+	kfree(mix->out);
+	kfree(mix);
+	return err;
+}
+EXPORT_SYMBOL_GPL(snd_pcm_mix_new);
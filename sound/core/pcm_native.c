@@ -24,6 +24,9 @@
 #include <sound/minors.h>
 #include <linux/uio.h>
 #include <linux/delay.h>
+#ifdef CONFIG_ARM
+#include <asm/cachetype.h>
+#endif
 
 #include "pcm_local.h"
 
@@ -492,19 +495,130 @@ static int fixup_unreferenced_params(struct snd_pcm_substream *substream,
 	return 0;
 }
 
-int snd_pcm_hw_refine(struct snd_pcm_substream *substream,
-		      struct snd_pcm_hw_params *params)
-{
+/*
+ * hw_refine cache
+ *
+ * User space probes the configuration space with many HW_REFINE calls per
+ * open, often with identical parameter sets, and each of them runs the whole
+ * rule engine.  Keep the recent results per substream.  The result depends
+ * on the constraints of the runtime, and for some drivers also on the state
+ * of the other streams and on mixer settings of the card; both are tracked
+ * by serial numbers, and a change of either drops the cached entries.
+ * Rules depending on anything else, e.g. the jack or clock state or
+ * settings changed from the kernel side, would see stale results, so the
+ * cache is only used for PCMs whose driver sets pcm->hw_refine_cache.
+ * Note that a cache hit emits no hw_mask_param/hw_interval_param traces.
+ */
+static bool hw_refine_cache = true;
+module_param(hw_refine_cache, bool, 0644);
+MODULE_PARM_DESC(hw_refine_cache, "Allow caching hw_params refine results for PCMs that opt in.");
+
+#define HW_REFINE_CACHE_SIZE	8
+
+struct snd_pcm_hw_refine_entry {
+	struct snd_pcm_hw_params key;		/* params passed in */
+	struct snd_pcm_hw_params result;	/* params handed back */
 	int err;
+};
 
-	params->info = 0;
-	params->fifo_size = 0;
-	if (params->rmask & PARAM_MASK_BIT(SNDRV_PCM_HW_PARAM_SAMPLE_BITS))
-		params->msbits = 0;
-	if (params->rmask & PARAM_MASK_BIT(SNDRV_PCM_HW_PARAM_RATE)) {
-		params->rate_num = 0;
-		params->rate_den = 0;
+struct snd_pcm_hw_refine_cache {
+	struct mutex lock;
+	unsigned int constr_serial;	/* hw_constraints.serial of entries */
+	unsigned int card_serial;	/* card->hw_refine_serial of entries */
+	unsigned int used;		/* number of valid entries */
+	unsigned int next;		/* entry to be replaced next */
+	struct snd_pcm_hw_refine_entry entries[HW_REFINE_CACHE_SIZE];
+};
+
+static void hw_refine_cache_init(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct snd_pcm_hw_refine_cache *cache;
+
+	if (!hw_refine_cache || !substream->pcm->hw_refine_cache)
+		return;
+	/* not fatal, refine just runs uncached */
+	cache = kvzalloc(sizeof(*cache), GFP_KERNEL);
+	if (!cache)
+		return;
+	mutex_init(&cache->lock);
+	runtime->refine_cache = cache;
+}
+
+static void hw_refine_cache_free(struct snd_pcm_runtime *runtime)
+{
+	kvfree(runtime->refine_cache);
+	runtime->refine_cache = NULL;
+}
+
+/* the state seen by the hw rules of the card may have been changed */
+static void hw_refine_cache_invalidate(struct snd_pcm_substream *substream)
+{
+	atomic_inc(&substream->pcm->card->hw_refine_serial);
+}
+
+/* look up the given params; call with cache->lock held */
+static struct snd_pcm_hw_refine_entry *
+hw_refine_cache_find(struct snd_pcm_substream *substream,
+		     const struct snd_pcm_hw_params *params)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct snd_pcm_hw_refine_cache *cache = runtime->refine_cache;
+	unsigned int card_serial =
+		atomic_read(&substream->pcm->card->hw_refine_serial);
+	unsigned int i;
+
+	if (cache->constr_serial != runtime->hw_constraints.serial ||
+	    cache->card_serial != card_serial) {
+		cache->constr_serial = runtime->hw_constraints.serial;
+		cache->card_serial = card_serial;
+		cache->used = 0;
+		cache->next = 0;
+		return NULL;
+	}
+
+	for (i = 0; i < cache->used; i++) {
+		if (!memcmp(&cache->entries[i].key, params, sizeof(*params)))
+			return &cache->entries[i];
 	}
+	return NULL;
+}
+
+/* store the result unless the serials moved on while refining */
+static void hw_refine_cache_store(struct snd_pcm_substream *substream,
+				  const struct snd_pcm_hw_params *key,
+				  const struct snd_pcm_hw_params *params,
+				  int err, unsigned int constr_serial,
+				  unsigned int card_serial)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct snd_pcm_hw_refine_cache *cache = runtime->refine_cache;
+	struct snd_pcm_hw_refine_entry *e;
+
+	/* -ENOMEM and co are no property of the params */
+	if (err < 0 && err != -EINVAL)
+		return;
+
+	mutex_lock(&cache->lock);
+	if (cache->constr_serial == constr_serial &&
+	    cache->card_serial == card_serial &&
+	    runtime->hw_constraints.serial == constr_serial &&
+	    atomic_read(&substream->pcm->card->hw_refine_serial) == card_serial) {
+		e = &cache->entries[cache->next];
+		e->key = *key;
+		e->result = *params;
+		e->err = err;
+		cache->next = (cache->next + 1) % HW_REFINE_CACHE_SIZE;
+		if (cache->used < HW_REFINE_CACHE_SIZE)
+			cache->used++;
+	}
+	mutex_unlock(&cache->lock);
+}
+
+static int do_hw_refine(struct snd_pcm_substream *substream,
+			struct snd_pcm_hw_params *params)
+{
+	int err;
 
 	err = constrain_mask_params(substream, params);
 	if (err < 0)
@@ -522,6 +636,52 @@ int snd_pcm_hw_refine(struct snd_pcm_substream *substream,
 
 	return 0;
 }
+
+int snd_pcm_hw_refine(struct snd_pcm_substream *substream,
+		      struct snd_pcm_hw_params *params)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct snd_pcm_hw_refine_cache *cache = runtime->refine_cache;
+	struct snd_pcm_hw_refine_entry *e;
+	struct snd_pcm_hw_params *key = NULL;
+	unsigned int constr_serial = 0, card_serial = 0;
+	int err;
+
+	params->info = 0;
+	params->fifo_size = 0;
+	if (params->rmask & PARAM_MASK_BIT(SNDRV_PCM_HW_PARAM_SAMPLE_BITS))
+		params->msbits = 0;
+	if (params->rmask & PARAM_MASK_BIT(SNDRV_PCM_HW_PARAM_RATE)) {
+		params->rate_num = 0;
+		params->rate_den = 0;
+	}
+
+	if (!cache)
+		return do_hw_refine(substream, params);
+
+	mutex_lock(&cache->lock);
+	runtime->refine_calls++;
+	e = hw_refine_cache_find(substream, params);
+	if (e) {
+		runtime->refine_hits++;
+		*params = e->result;
+		err = e->err;
+		mutex_unlock(&cache->lock);
+		return err;
+	}
+	constr_serial = cache->constr_serial;
+	card_serial = cache->card_serial;
+	mutex_unlock(&cache->lock);
+
+	key = kmemdup(params, sizeof(*params), GFP_KERNEL);
+	err = do_hw_refine(substream, params);
+	if (key) {
+		hw_refine_cache_store(substream, key, params, err,
+				      constr_serial, card_serial);
+		kfree(key);
+	}
+	return err;
+}
 EXPORT_SYMBOL(snd_pcm_hw_refine);
 
 static int snd_pcm_hw_refine_user(struct snd_pcm_substream *substream,
@@ -729,6 +889,10 @@ static int snd_pcm_hw_params(struct snd_pcm_substream *substream,
 	runtime->no_period_wakeup =
 			(params->info & SNDRV_PCM_INFO_NO_PERIOD_WAKEUP) &&
 			(params->flags & SNDRV_PCM_HW_PARAMS_NO_PERIOD_WAKEUP);
+	/* the timer takes the stream lock, hence atomic PCMs only */
+	runtime->tsched =
+			(params->flags & SNDRV_PCM_HW_PARAMS_TIMER_WAKEUP) &&
+			!substream->pcm->nonatomic;
 
 	bits = snd_pcm_format_physical_width(runtime->format);
 	runtime->sample_bits = bits;
@@ -765,6 +929,7 @@ static int snd_pcm_hw_params(struct snd_pcm_substream *substream,
 
 	snd_pcm_timer_resolution_change(substream);
 	snd_pcm_set_state(substream, SNDRV_PCM_STATE_SETUP);
+	hw_refine_cache_invalidate(substream);
 
 	if (cpu_latency_qos_request_active(&substream->latency_pm_qos_req))
 		cpu_latency_qos_remove_request(&substream->latency_pm_qos_req);
@@ -781,6 +946,7 @@ static int snd_pcm_hw_params(struct snd_pcm_substream *substream,
 		substream->ops->hw_free(substream);
 	if (substream->managed_buffer_alloc)
 		snd_pcm_lib_free_pages(substream);
+	hw_refine_cache_invalidate(substream);
 	return err;
 }
 
@@ -809,11 +975,13 @@ static int do_hw_free(struct snd_pcm_substream *substream)
 {
 	int result = 0;
 
+	hrtimer_cancel(&substream->tsched_timer);
 	snd_pcm_sync_stop(substream, true);
 	if (substream->ops->hw_free)
 		result = substream->ops->hw_free(substream);
 	if (substream->managed_buffer_alloc)
 		snd_pcm_lib_free_pages(substream);
+	hw_refine_cache_invalidate(substream);
 	return result;
 }
 
@@ -1371,6 +1539,7 @@ static void snd_pcm_post_start(struct snd_pcm_substream *substream,
 	runtime->hw_ptr_buffer_jiffies = (runtime->buffer_size * HZ) / 
 							    runtime->rate;
 	runtime->status->state = state;
+	snd_pcm_hist_start(substream);
 	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK &&
 	    runtime->silence_size > 0)
 		snd_pcm_playback_silence(substream, ULONG_MAX);
@@ -1437,6 +1606,8 @@ static void snd_pcm_post_stop(struct snd_pcm_substream *substream,
 		runtime->status->state = state;
 		snd_pcm_timer_notify(substream, SNDRV_TIMER_EVENT_MSTOP);
 	}
+	if (runtime->tsched)
+		hrtimer_try_to_cancel(&substream->tsched_timer);
 	wake_up(&runtime->sleep);
 	wake_up(&runtime->tsleep);
 }
@@ -2631,6 +2802,7 @@ void snd_pcm_release_substream(struct snd_pcm_substream *substream)
 			do_hw_free(substream);
 		substream->ops->close(substream);
 		substream->hw_opened = 0;
+		hw_refine_cache_invalidate(substream);
 	}
 	if (cpu_latency_qos_request_active(&substream->latency_pm_qos_req))
 		cpu_latency_qos_remove_request(&substream->latency_pm_qos_req);
@@ -2638,6 +2810,7 @@ void snd_pcm_release_substream(struct snd_pcm_substream *substream)
 		substream->pcm_release(substream);
 		substream->pcm_release = NULL;
 	}
+	hw_refine_cache_free(substream->runtime);
 	snd_pcm_detach_substream(substream);
 }
 EXPORT_SYMBOL(snd_pcm_release_substream);
@@ -2674,6 +2847,9 @@ int snd_pcm_open_substream(struct snd_pcm *pcm, int stream,
 		goto error;
 	}
 
+	hw_refine_cache_init(substream);
+	hw_refine_cache_invalidate(substream);
+
 	*rsubstream = substream;
 	return 0;
 
@@ -3156,6 +3332,37 @@ static int snd_pcm_xfern_frames_ioctl(struct snd_pcm_substream *substream,
 	return result < 0 ? result : 0;
 }
 
+static int snd_pcm_xferiv_frames_ioctl(struct snd_pcm_substream *substream,
+				       struct snd_xferiv __user *_xferiv)
+{
+	struct snd_xferiv xferiv;
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct snd_xferi_iov *iov;
+	snd_pcm_sframes_t result;
+
+	if (runtime->status->state == SNDRV_PCM_STATE_OPEN)
+		return -EBADFD;
+	if (substream->stream != SNDRV_PCM_STREAM_PLAYBACK)
+		return -EINVAL;
+	if (put_user(0, &_xferiv->result))
+		return -EFAULT;
+	if (copy_from_user(&xferiv, _xferiv, sizeof(xferiv)))
+		return -EFAULT;
+	if (!xferiv.nr_segs)
+		return 0;
+	if (xferiv.nr_segs > SNDRV_PCM_XFERIV_MAX_SEGS)
+		return -EINVAL;
+
+	iov = memdup_user(xferiv.iov, sizeof(*iov) * xferiv.nr_segs);
+	if (IS_ERR(iov))
+		return PTR_ERR(iov);
+	result = snd_pcm_lib_write_iov(substream, iov, xferiv.nr_segs);
+	kfree(iov);
+	if (put_user(result, &_xferiv->result))
+		return -EFAULT;
+	return result < 0 ? result : 0;
+}
+
 static int snd_pcm_rewind_ioctl(struct snd_pcm_substream *substream,
 				snd_pcm_uframes_t __user *_frames)
 {
@@ -3285,6 +3492,8 @@ static int snd_pcm_common_ioctl(struct file *file,
 	case SNDRV_PCM_IOCTL_WRITEN_FRAMES:
 	case SNDRV_PCM_IOCTL_READN_FRAMES:
 		return snd_pcm_xfern_frames_ioctl(substream, arg);
+	case SNDRV_PCM_IOCTL_WRITEIV_FRAMES:
+		return snd_pcm_xferiv_frames_ioctl(substream, arg);
 	case SNDRV_PCM_IOCTL_REWIND:
 		return snd_pcm_rewind_ioctl(substream, arg);
 	case SNDRV_PCM_IOCTL_FORWARD:
@@ -3495,13 +3704,20 @@ static __poll_t snd_pcm_poll(struct file *file, poll_table *wait)
 
 	mask = 0;
 	snd_pcm_stream_lock_irq(substream);
+	/* no period interrupts may have refreshed hw_ptr in tsched mode */
+	if (runtime->tsched &&
+	    runtime->status->state == SNDRV_PCM_STATE_RUNNING)
+		snd_pcm_update_hw_ptr(substream);
 	avail = snd_pcm_avail(substream);
 	switch (runtime->status->state) {
 	case SNDRV_PCM_STATE_RUNNING:
 	case SNDRV_PCM_STATE_PREPARED:
 	case SNDRV_PCM_STATE_PAUSED:
-		if (avail >= runtime->control->avail_min)
+		if (avail >= runtime->control->avail_min) {
 			mask = ok;
+			snd_pcm_hist_wakeup(substream);
+		} else
+			snd_pcm_tsched_arm(substream);
 		break;
 	case SNDRV_PCM_STATE_DRAINING:
 		if (substream->stream == SNDRV_PCM_STREAM_CAPTURE) {
@@ -3526,7 +3742,23 @@ static __poll_t snd_pcm_poll(struct file *file, poll_table *wait)
  * Only on coherent architectures, we can mmap the status and the control records
  * for effcient data transfer.  On others, we have to use HWSYNC ioctl...
  */
-#if defined(CONFIG_X86) || defined(CONFIG_PPC) || defined(CONFIG_ALPHA)
+#if defined(CONFIG_X86) || defined(CONFIG_PPC) || defined(CONFIG_ALPHA) || \
+	defined(CONFIG_ARM)
+
+#ifdef CONFIG_ARM
+/*
+ * ARM is coherent in this regard unless the D-cache can alias: with a VIVT
+ * or an aliasing VIPT cache, the kernel and the user mappings of the record
+ * pages may sit in different cache lines.  ARMv7 and later never alias.
+ */
+static bool pcm_mmap_coherent(void)
+{
+	return !cache_is_vivt() && !cache_is_vipt_aliasing();
+}
+#else
+#define pcm_mmap_coherent()	true
+#endif
+
 /*
  * mmap status record
  */
@@ -3601,6 +3833,8 @@ static int snd_pcm_mmap_control(struct snd_pcm_substream *substream, struct file
 
 static bool pcm_status_mmap_allowed(struct snd_pcm_file *pcm_file)
 {
+	if (!pcm_mmap_coherent())
+		return false;
 	/* See pcm_control_mmap_allowed() below.
 	 * Since older alsa-lib requires both status and control mmaps to be
 	 * coupled, we have to disable the status mmap for old alsa-lib, too.
@@ -3613,6 +3847,8 @@ static bool pcm_status_mmap_allowed(struct snd_pcm_file *pcm_file)
 
 static bool pcm_control_mmap_allowed(struct snd_pcm_file *pcm_file)
 {
+	if (!pcm_mmap_coherent())
+		return false;
 	if (pcm_file->no_compat_mmap)
 		return false;
 	/* Disallow the control mmap when SYNC_APPLPTR flag is set;
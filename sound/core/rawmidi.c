@@ -685,6 +685,12 @@ static int resize_runtime_buffer(struct snd_rawmidi_runtime *runtime,
 		return -EINVAL;
 	if (params->avail_min < 1 || params->avail_min > params->buffer_size)
 		return -EINVAL;
+	/* the ring must hold whole frames */
+	if (is_input &&
+	    (params->mode & SNDRV_RAWMIDI_MODE_FRAMING_MASK) ==
+	    SNDRV_RAWMIDI_MODE_FRAMING_TSTAMP &&
+	    params->buffer_size % sizeof(struct snd_rawmidi_framing_tstamp))
+		return -EINVAL;
 	if (params->buffer_size != runtime->buffer_size) {
 		newbuf = kvzalloc(params->buffer_size, GFP_KERNEL);
 		if (!newbuf)
@@ -720,8 +726,41 @@ EXPORT_SYMBOL(snd_rawmidi_output_params);
 int snd_rawmidi_input_params(struct snd_rawmidi_substream *substream,
 			     struct snd_rawmidi_params *params)
 {
+	struct snd_rawmidi_runtime *runtime = substream->runtime;
+	unsigned int framing = params->mode & SNDRV_RAWMIDI_MODE_FRAMING_MASK;
+	unsigned int clock_type = params->mode & SNDRV_RAWMIDI_MODE_CLOCK_MASK;
+	int err;
+
+	switch (framing) {
+	case SNDRV_RAWMIDI_MODE_FRAMING_NONE:
+		if (clock_type != SNDRV_RAWMIDI_MODE_CLOCK_NONE)
+			return -EINVAL;
+		break;
+	case SNDRV_RAWMIDI_MODE_FRAMING_TSTAMP:
+		if (clock_type == SNDRV_RAWMIDI_MODE_CLOCK_NONE ||
+		    clock_type > SNDRV_RAWMIDI_MODE_CLOCK_MONOTONIC_RAW)
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+
 	snd_rawmidi_drain_input(substream);
-	return resize_runtime_buffer(substream->runtime, params, true);
+	err = resize_runtime_buffer(runtime, params, true);
+	if (err < 0)
+		return err;
+
+	/* the buffer may hold bytes of the previous mode */
+	spin_lock_irq(&runtime->lock);
+	runtime->framing = framing;
+	runtime->clock_type = clock_type;
+	if (framing == SNDRV_RAWMIDI_MODE_FRAMING_TSTAMP)
+		runtime->align = sizeof(struct snd_rawmidi_framing_tstamp) - 1;
+	else
+		runtime->align = 0;
+	__reset_runtime_ptrs(runtime, true);
+	spin_unlock_irq(&runtime->lock);
+	return 0;
 }
 EXPORT_SYMBOL(snd_rawmidi_input_params);
 
@@ -963,6 +1002,68 @@ static int snd_rawmidi_control_ioctl(struct snd_card *card,
 	return -ENOIOCTLCMD;
 }
 
+static void get_framing_tstamp(struct snd_rawmidi_substream *substream,
+			       struct timespec64 *ts64)
+{
+	switch (substream->runtime->clock_type) {
+	case SNDRV_RAWMIDI_MODE_CLOCK_MONOTONIC_RAW:
+		ktime_get_raw_ts64(ts64);
+		break;
+	case SNDRV_RAWMIDI_MODE_CLOCK_MONOTONIC:
+		ktime_get_ts64(ts64);
+		break;
+	case SNDRV_RAWMIDI_MODE_CLOCK_REALTIME:
+		ktime_get_real_ts64(ts64);
+		break;
+	default:
+		ts64->tv_sec = 0;
+		ts64->tv_nsec = 0;
+		break;
+	}
+}
+
+/*
+ * Store the received chunk in frames of up to
+ * SNDRV_RAWMIDI_FRAMING_DATA_LENGTH bytes, all with the same timestamp;
+ * called with runtime->lock held.
+ */
+static int receive_with_tstamp_framing(struct snd_rawmidi_substream *substream,
+				       const unsigned char *buffer, int count,
+				       const struct timespec64 *tstamp)
+{
+	struct snd_rawmidi_runtime *runtime = substream->runtime;
+	struct snd_rawmidi_framing_tstamp *dest;
+	const int frame_size = sizeof(*dest);
+	int result = 0;
+	int len;
+
+	BUILD_BUG_ON(sizeof(*dest) != 32);
+	if (snd_BUG_ON(runtime->hw_ptr % frame_size))
+		return -EINVAL;
+
+	while (count > 0) {
+		if ((int)(runtime->buffer_size - runtime->avail) < frame_size) {
+			runtime->xruns += count;
+			break;
+		}
+		len = min(count, SNDRV_RAWMIDI_FRAMING_DATA_LENGTH);
+		dest = (struct snd_rawmidi_framing_tstamp *)
+			(runtime->buffer + runtime->hw_ptr);
+		memset(dest, 0, frame_size);
+		dest->length = len;
+		dest->tv_sec = tstamp->tv_sec;
+		dest->tv_nsec = tstamp->tv_nsec;
+		memcpy(dest->data, buffer, len);
+		buffer += len;
+		count -= len;
+		result += len;
+		runtime->avail += frame_size;
+		runtime->hw_ptr += frame_size;
+		runtime->hw_ptr %= runtime->buffer_size;
+	}
+	return result;
+}
+
 /**
  * snd_rawmidi_receive - receive the input data from the device
  * @substream: the rawmidi substream
@@ -977,6 +1078,7 @@ int snd_rawmidi_receive(struct snd_rawmidi_substream *substream,
 			const unsigned char *buffer, int count)
 {
 	unsigned long flags;
+	struct timespec64 ts64 = {0, 0};
 	int result = 0, count1;
 	struct snd_rawmidi_runtime *runtime = substream->runtime;
 
@@ -987,8 +1089,15 @@ int snd_rawmidi_receive(struct snd_rawmidi_substream *substream,
 			  "snd_rawmidi_receive: input is not active!!!\n");
 		return -EINVAL;
 	}
+	/* stamp the arrival before contending for the lock */
+	if (runtime->framing == SNDRV_RAWMIDI_MODE_FRAMING_TSTAMP)
+		get_framing_tstamp(substream, &ts64);
 	spin_lock_irqsave(&runtime->lock, flags);
-	if (count == 1) {	/* special case, faster code */
+	if (runtime->framing == SNDRV_RAWMIDI_MODE_FRAMING_TSTAMP) {
+		substream->bytes += count;
+		result = receive_with_tstamp_framing(substream, buffer, count,
+						     &ts64);
+	} else if (count == 1) {	/* special case, faster code */
 		substream->bytes++;
 		if (runtime->avail < runtime->buffer_size) {
 			runtime->buffer[runtime->hw_ptr++] = buffer[0];
@@ -1085,6 +1194,14 @@ static long snd_rawmidi_kernel_read1(struct snd_rawmidi_substream *substream,
 long snd_rawmidi_kernel_read(struct snd_rawmidi_substream *substream,
 			     unsigned char *buf, long count)
 {
+	struct snd_rawmidi_runtime *runtime = substream->runtime;
+
+	/* in framing mode, whole frames only; count 0 just triggers input */
+	if (runtime->framing) {
+		if (count && count <= (long)runtime->align)
+			return -EINVAL;
+		count &= ~(long)runtime->align;
+	}
 	snd_rawmidi_input_trigger(substream, 1);
 	return snd_rawmidi_kernel_read1(substream, NULL/*userbuf*/, buf, count);
 }
@@ -1104,6 +1221,12 @@ static ssize_t snd_rawmidi_read(struct file *file, char __user *buf, size_t coun
 	if (substream == NULL)
 		return -EIO;
 	runtime = substream->runtime;
+	/* in framing mode, return as many whole frames as fit */
+	if (runtime->framing) {
+		if (count <= runtime->align)
+			return -EINVAL;
+		count &= ~runtime->align;
+	}
 	snd_rawmidi_input_trigger(substream, 1);
 	result = 0;
 	while (count > 0) {
@@ -89,6 +89,7 @@ static int __init alsa_seq_init(void)
 		goto error_info;
 
 	snd_seq_autoload_init();
+	snd_seq_prioq_test_init();
 	return 0;
 
  error_info:
@@ -101,6 +102,8 @@ static int __init alsa_seq_init(void)
 
 static void __exit alsa_seq_exit(void)
 {
+	snd_seq_prioq_test_exit();
+
 	/* unregister our internal client */
 	snd_seq_system_client_done();
 
@@ -66,8 +66,10 @@ static struct snd_seq_usage client_usage;
 static int bounce_error_event(struct snd_seq_client *client,
 			      struct snd_seq_event *event,
 			      int err, int atomic, int hop);
+struct seq_fanout;
 static int snd_seq_deliver_single_event(struct snd_seq_client *client,
 					struct snd_seq_event *event,
+					struct seq_fanout *fanout,
 					int filter, int atomic, int hop);
 
 /*
@@ -554,7 +556,8 @@ static int bounce_error_event(struct snd_seq_client *client,
 	bounce_ev.data.quote.origin = event->dest;
 	bounce_ev.data.quote.event = event;
 	bounce_ev.data.quote.value = -err; /* use positive value */
-	result = snd_seq_deliver_single_event(NULL, &bounce_ev, 0, atomic, hop + 1);
+	result = snd_seq_deliver_single_event(NULL, &bounce_ev, NULL, 0, atomic,
+					      hop + 1);
 	if (result < 0) {
 		client->event_lost++;
 		return result;
@@ -591,19 +594,44 @@ static int update_timestamp_of_queue(struct snd_seq_event *event,
 }
 
 
+/*
+ * ext data of an event delivered to multiple destinations; it is copied
+ * once when the second user client is reached, and the user client FIFOs
+ * from then on refer to that copy.  Kernel clients never need it.
+ */
+struct seq_fanout {
+	struct snd_seq_shared_data *shared;
+	int user_dests;
+};
+
+static struct snd_seq_shared_data *
+get_shared_data(struct seq_fanout *fanout, struct snd_seq_event *event,
+		int atomic)
+{
+	if (!fanout || !snd_seq_ev_is_variable(event))
+		return NULL;
+	if (++fanout->user_dests == 2)
+		fanout->shared = snd_seq_shared_data_new(event,
+					atomic ? GFP_ATOMIC : GFP_KERNEL);
+	return fanout->shared;
+}
+
 /*
  * deliver an event to the specified destination.
  * if filter is non-zero, client filter bitmap is tested.
+ * if fanout is given, the event is one of multiple deliveries.
  *
  *  RETURN VALUE: 0 : if succeeded
  *		 <0 : error
  */
 static int snd_seq_deliver_single_event(struct snd_seq_client *client,
 					struct snd_seq_event *event,
+					struct seq_fanout *fanout,
 					int filter, int atomic, int hop)
 {
 	struct snd_seq_client *dest = NULL;
 	struct snd_seq_client_port *dest_port = NULL;
+	struct snd_seq_shared_data *shared;
 	int result = -ENOENT;
 	int direct;
 
@@ -628,8 +656,11 @@ static int snd_seq_deliver_single_event(struct snd_seq_client *client,
 
 	switch (dest->type) {
 	case USER_CLIENT:
-		if (dest->data.user.fifo)
-			result = snd_seq_fifo_event_in(dest->data.user.fifo, event);
+		if (!dest->data.user.fifo)
+			break;
+		shared = get_shared_data(fanout, event, atomic);
+		result = snd_seq_fifo_event_in_shared(dest->data.user.fifo,
+						      event, shared);
 		break;
 
 	case KERNEL_CLIENT:
@@ -668,6 +699,7 @@ static int deliver_to_subscribers(struct snd_seq_client *client,
 	struct snd_seq_event event_saved;
 	struct snd_seq_client_port *src_port;
 	struct snd_seq_port_subs_info *grp;
+	struct seq_fanout fanout = {};
 
 	src_port = snd_seq_port_use_ptr(client, event->source.port);
 	if (src_port == NULL)
@@ -690,7 +722,7 @@ static int deliver_to_subscribers(struct snd_seq_client *client,
 			/* convert time according to flag with subscription */
 			update_timestamp_of_queue(event, subs->info.queue,
 						  subs->info.flags & SNDRV_SEQ_PORT_SUBS_TIME_REAL);
-		err = snd_seq_deliver_single_event(client, event,
+		err = snd_seq_deliver_single_event(client, event, &fanout,
 						   0, atomic, hop);
 		if (err < 0) {
 			/* save first error that occurs and continue */
@@ -706,6 +738,7 @@ static int deliver_to_subscribers(struct snd_seq_client *client,
 		read_unlock(&grp->list_lock);
 	else
 		up_read(&grp->list_mutex);
+	snd_seq_shared_data_put(fanout.shared);
 	*event = event_saved; /* restore */
 	snd_seq_port_unlock(src_port);
 	return (result < 0) ? result : num_ev;
@@ -718,6 +751,7 @@ static int deliver_to_subscribers(struct snd_seq_client *client,
  */
 static int port_broadcast_event(struct snd_seq_client *client,
 				struct snd_seq_event *event,
+				struct seq_fanout *fanout,
 				int atomic, int hop)
 {
 	int num_ev = 0, err, result = 0;
@@ -732,7 +766,7 @@ static int port_broadcast_event(struct snd_seq_client *client,
 	list_for_each_entry(port, &dest_client->ports_list_head, list) {
 		event->dest.port = port->addr.port;
 		/* pass NULL as source client to avoid error bounce */
-		err = snd_seq_deliver_single_event(NULL, event,
+		err = snd_seq_deliver_single_event(NULL, event, fanout,
 						   SNDRV_SEQ_FILTER_BROADCAST,
 						   atomic, hop);
 		if (err < 0) {
@@ -759,6 +793,7 @@ static int broadcast_event(struct snd_seq_client *client,
 	int err, result = 0, num_ev = 0;
 	int dest;
 	struct snd_seq_addr addr;
+	struct seq_fanout fanout = {};
 
 	addr = event->dest; /* save */
 
@@ -769,10 +804,11 @@ static int broadcast_event(struct snd_seq_client *client,
 		event->dest.client = dest;
 		event->dest.port = addr.port;
 		if (addr.port == SNDRV_SEQ_ADDRESS_BROADCAST)
-			err = port_broadcast_event(client, event, atomic, hop);
+			err = port_broadcast_event(client, event, &fanout,
+						   atomic, hop);
 		else
 			/* pass NULL as source client to avoid error bounce */
-			err = snd_seq_deliver_single_event(NULL, event,
+			err = snd_seq_deliver_single_event(NULL, event, &fanout,
 							   SNDRV_SEQ_FILTER_BROADCAST,
 							   atomic, hop);
 		if (err < 0) {
@@ -783,6 +819,7 @@ static int broadcast_event(struct snd_seq_client *client,
 		}
 		num_ev += err;
 	}
+	snd_seq_shared_data_put(fanout.shared);
 	event->dest = addr; /* restore */
 	return (result < 0) ? result : num_ev;
 }
@@ -832,11 +869,17 @@ static int snd_seq_deliver_event(struct snd_seq_client *client, struct snd_seq_e
 		result = broadcast_event(client, event, atomic, hop);
 	else if (event->dest.client >= SNDRV_SEQ_MAX_CLIENTS)
 		result = multicast_event(client, event, atomic, hop);
-	else if (event->dest.port == SNDRV_SEQ_ADDRESS_BROADCAST)
-		result = port_broadcast_event(client, event, atomic, hop);
+	else if (event->dest.port == SNDRV_SEQ_ADDRESS_BROADCAST) {
+		struct seq_fanout fanout = {};
+
+		result = port_broadcast_event(client, event, &fanout,
+					      atomic, hop);
+		snd_seq_shared_data_put(fanout.shared);
+	}
 #endif
 	else
-		result = snd_seq_deliver_single_event(client, event, 0, atomic, hop);
+		result = snd_seq_deliver_single_event(client, event, NULL, 0,
+						      atomic, hop);
 
 	return result;
 }
@@ -39,9 +39,9 @@ struct snd_seq_fifo *snd_seq_fifo_new(int poolsize)
 	init_waitqueue_head(&f->input_sleep);
 	atomic_set(&f->overflow, 0);
 
+	f->in = NULL;
 	f->head = NULL;
-	f->tail = NULL;
-	f->cells = 0;
+	atomic_set(&f->cells, 0);
 	
 	return f;
 }
@@ -88,28 +88,73 @@ void snd_seq_fifo_clear(struct snd_seq_fifo *f)
 	atomic_set(&f->overflow, 0);
 
 	snd_use_lock_sync(&f->use_lock);
-	spin_lock_irq(&f->lock);
+	spin_lock(&f->lock);
 	/* drain the fifo */
 	while ((cell = fifo_cell_out(f)) != NULL) {
 		snd_seq_cell_free(cell);
 	}
-	spin_unlock_irq(&f->lock);
+	spin_unlock(&f->lock);
+}
+
+/* push a cell onto the input stack; safe against concurrent producers */
+static void fifo_cell_in(struct snd_seq_fifo *f,
+			 struct snd_seq_event_cell *cell)
+{
+	struct snd_seq_event_cell *first;
+
+	/* count first, so the reader never takes a cell not counted yet */
+	atomic_inc(&f->cells);
+	do {
+		first = READ_ONCE(f->in);
+		cell->next = first;
+	} while (cmpxchg(&f->in, first, cell) != first);
+}
+
+/* move all pushed cells to the tail of the head list in arrival order;
+ * call with f->lock held
+ */
+static void fifo_take_input(struct snd_seq_fifo *f)
+{
+	struct snd_seq_event_cell *cell, *next, *list = NULL;
+	struct snd_seq_event_cell **tailp;
+
+	cell = xchg(&f->in, NULL);
+	if (!cell)
+		return;
+	for (; cell; cell = next) {
+		next = cell->next;
+		cell->next = list;
+		list = cell;
+	}
+	for (tailp = &f->head; *tailp; tailp = &(*tailp)->next)
+		;
+	*tailp = list;
 }
 
 
 /* enqueue event to fifo */
 int snd_seq_fifo_event_in(struct snd_seq_fifo *f,
 			  struct snd_seq_event *event)
+{
+	return snd_seq_fifo_event_in_shared(f, event, NULL);
+}
+
+/* enqueue event to fifo, referring to the shared ext data if given */
+int snd_seq_fifo_event_in_shared(struct snd_seq_fifo *f,
+				 struct snd_seq_event *event,
+				 struct snd_seq_shared_data *shared)
 {
 	struct snd_seq_event_cell *cell;
-	unsigned long flags;
 	int err;
 
 	if (snd_BUG_ON(!f))
 		return -EINVAL;
 
 	snd_use_lock_use(&f->use_lock);
-	err = snd_seq_event_dup(f->pool, event, &cell, 1, NULL, NULL); /* always non-blocking */
+	if (shared && snd_seq_ev_is_variable(event))
+		err = snd_seq_event_dup_shared(f->pool, event, shared, &cell);
+	else
+		err = snd_seq_event_dup(f->pool, event, &cell, 1, NULL, NULL); /* always non-blocking */
 	if (err < 0) {
 		if ((err == -ENOMEM) || (err == -EAGAIN))
 			atomic_inc(&f->overflow);
@@ -118,18 +163,10 @@ int snd_seq_fifo_event_in(struct snd_seq_fifo *f,
 	}
 		
 	/* append new cells to fifo */
-	spin_lock_irqsave(&f->lock, flags);
-	if (f->tail != NULL)
-		f->tail->next = cell;
-	f->tail = cell;
-	if (f->head == NULL)
-		f->head = cell;
-	cell->next = NULL;
-	f->cells++;
-	spin_unlock_irqrestore(&f->lock, flags);
+	fifo_cell_in(f, cell);
 
-	/* wakeup client */
-	if (waitqueue_active(&f->input_sleep))
+	/* wakeup client; pairs with set_current_state() in cell_out */
+	if (wq_has_sleeper(&f->input_sleep))
 		wake_up(&f->input_sleep);
 
 	snd_use_lock_free(&f->use_lock);
@@ -138,20 +175,17 @@ int snd_seq_fifo_event_in(struct snd_seq_fifo *f,
 
 }
 
-/* dequeue cell from fifo */
+/* dequeue cell from fifo; call with f->lock held */
 static struct snd_seq_event_cell *fifo_cell_out(struct snd_seq_fifo *f)
 {
 	struct snd_seq_event_cell *cell;
 
+	if (!f->head)
+		fifo_take_input(f);
 	if ((cell = f->head) != NULL) {
 		f->head = cell->next;
-
-		/* reset tail if this was the last element */
-		if (f->tail == cell)
-			f->tail = NULL;
-
 		cell->next = NULL;
-		f->cells--;
+		atomic_dec(&f->cells);
 	}
 
 	return cell;
@@ -162,7 +196,6 @@ int snd_seq_fifo_cell_out(struct snd_seq_fifo *f,
 			  struct snd_seq_event_cell **cellp, int nonblock)
 {
 	struct snd_seq_event_cell *cell;
-	unsigned long flags;
 	wait_queue_entry_t wait;
 
 	if (snd_BUG_ON(!f))
@@ -170,25 +203,28 @@ int snd_seq_fifo_cell_out(struct snd_seq_fifo *f,
 
 	*cellp = NULL;
 	init_waitqueue_entry(&wait, current);
-	spin_lock_irqsave(&f->lock, flags);
+	spin_lock(&f->lock);
 	while ((cell = fifo_cell_out(f)) == NULL) {
 		if (nonblock) {
 			/* non-blocking - return immediately */
-			spin_unlock_irqrestore(&f->lock, flags);
+			spin_unlock(&f->lock);
 			return -EAGAIN;
 		}
-		set_current_state(TASK_INTERRUPTIBLE);
 		add_wait_queue(&f->input_sleep, &wait);
-		spin_unlock_irqrestore(&f->lock, flags);
-		schedule();
-		spin_lock_irqsave(&f->lock, flags);
+		set_current_state(TASK_INTERRUPTIBLE);
+		spin_unlock(&f->lock);
+		/* producers don't take the lock, so recheck after queuing */
+		if (!READ_ONCE(f->in))
+			schedule();
+		__set_current_state(TASK_RUNNING);
+		spin_lock(&f->lock);
 		remove_wait_queue(&f->input_sleep, &wait);
 		if (signal_pending(current)) {
-			spin_unlock_irqrestore(&f->lock, flags);
+			spin_unlock(&f->lock);
 			return -ERESTARTSYS;
 		}
 	}
-	spin_unlock_irqrestore(&f->lock, flags);
+	spin_unlock(&f->lock);
 	*cellp = cell;
 
 	return 0;
@@ -198,16 +234,12 @@ int snd_seq_fifo_cell_out(struct snd_seq_fifo *f,
 void snd_seq_fifo_cell_putback(struct snd_seq_fifo *f,
 			       struct snd_seq_event_cell *cell)
 {
-	unsigned long flags;
-
 	if (cell) {
-		spin_lock_irqsave(&f->lock, flags);
+		spin_lock(&f->lock);
 		cell->next = f->head;
 		f->head = cell;
-		if (!f->tail)
-			f->tail = cell;
-		f->cells++;
-		spin_unlock_irqrestore(&f->lock, flags);
+		atomic_inc(&f->cells);
+		spin_unlock(&f->lock);
 	}
 }
 
@@ -217,7 +249,7 @@ int snd_seq_fifo_poll_wait(struct snd_seq_fifo *f, struct file *file,
 			   poll_table *wait)
 {
 	poll_wait(file, &f->input_sleep, wait);
-	return (f->cells > 0);
+	return atomic_read(&f->cells) > 0;
 }
 
 /* change the size of pool; all old events are removed */
@@ -225,6 +257,8 @@ int snd_seq_fifo_resize(struct snd_seq_fifo *f, int poolsize)
 {
 	struct snd_seq_pool *newpool, *oldpool;
 	struct snd_seq_event_cell *cell, *next, *oldhead;
+	struct snd_seq_event_cell **cellp;
+	int detached = 0;
 
 	if (snd_BUG_ON(!f || !f->pool))
 		return -EINVAL;
@@ -238,22 +272,41 @@ int snd_seq_fifo_resize(struct snd_seq_fifo *f, int poolsize)
 		return -ENOMEM;
 	}
 
-	spin_lock_irq(&f->lock);
+	spin_lock(&f->lock);
 	/* remember old pool */
 	oldpool = f->pool;
+	fifo_take_input(f);
 	oldhead = f->head;
 	/* exchange pools */
 	f->pool = newpool;
 	f->head = NULL;
-	f->tail = NULL;
-	f->cells = 0;
+	/* producers keep counting without the lock; drop only what we took */
+	for (cell = oldhead; cell; cell = cell->next)
+		detached++;
+	atomic_sub(detached, &f->cells);
 	/* NOTE: overflow flag is not cleared */
-	spin_unlock_irq(&f->lock);
+	spin_unlock(&f->lock);
 
 	/* close the old pool and wait until all users are gone */
 	snd_seq_pool_mark_closing(oldpool);
 	snd_use_lock_sync(&f->use_lock);
 
+	/* producers racing with the exchange may have pushed old cells */
+	spin_lock(&f->lock);
+	fifo_take_input(f);
+	for (cellp = &f->head; *cellp; ) {
+		cell = *cellp;
+		if (cell->pool != oldpool) {
+			cellp = &cell->next;
+			continue;
+		}
+		*cellp = cell->next;
+		cell->next = oldhead;
+		oldhead = cell;
+		atomic_dec(&f->cells);
+	}
+	spin_unlock(&f->lock);
+
 	/* release cells in old pool */
 	for (cell = oldhead; cell; cell = next) {
 		next = cell->next;
@@ -267,16 +320,15 @@ int snd_seq_fifo_resize(struct snd_seq_fifo *f, int poolsize)
 /* get the number of unused cells safely */
 int snd_seq_fifo_unused_cells(struct snd_seq_fifo *f)
 {
-	unsigned long flags;
 	int cells;
 
 	if (!f)
 		return 0;
 
 	snd_use_lock_use(&f->use_lock);
-	spin_lock_irqsave(&f->lock, flags);
+	spin_lock(&f->lock);
 	cells = snd_seq_unused_cells(f->pool);
-	spin_unlock_irqrestore(&f->lock, flags);
+	spin_unlock(&f->lock);
 	snd_use_lock_free(&f->use_lock);
 	return cells;
 }
@@ -12,12 +12,18 @@
 
 /* === FIFO === */
 
+/*
+ * Producers push cells onto the lock-free input stack, in reverse order.
+ * The reader takes the whole stack at once, reverses it onto the head
+ * list and consumes from there; only the reader side takes the lock.
+ * The pool bounds the number of queued cells.
+ */
 struct snd_seq_fifo {
 	struct snd_seq_pool *pool;		/* FIFO pool */
+	struct snd_seq_event_cell *in;		/* newest input cell, lock-free */
 	struct snd_seq_event_cell *head;    	/* pointer to head of fifo */
-	struct snd_seq_event_cell *tail;    	/* pointer to tail of fifo */
-	int cells;
-	spinlock_t lock;
+	atomic_t cells;
+	spinlock_t lock;			/* protects head (reader side) */
 	snd_use_lock_t use_lock;
 	wait_queue_head_t input_sleep;
 	atomic_t overflow;
@@ -33,6 +39,9 @@ void snd_seq_fifo_delete(struct snd_seq_fifo **f);
 
 /* enqueue event to fifo */
 int snd_seq_fifo_event_in(struct snd_seq_fifo *f, struct snd_seq_event *event);
+int snd_seq_fifo_event_in_shared(struct snd_seq_fifo *f,
+				 struct snd_seq_event *event,
+				 struct snd_seq_shared_data *shared);
 
 /* lock fifo from release */
 #define snd_seq_fifo_lock(fifo)		snd_use_lock_use(&(fifo)->use_lock)
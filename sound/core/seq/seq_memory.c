@@ -11,6 +11,7 @@
 #include <linux/slab.h>
 #include <linux/sched/signal.h>
 #include <linux/mm.h>
+#include <linux/percpu.h>
 #include <sound/core.h>
 
 #include <sound/seq_kernel.h>
@@ -29,6 +30,15 @@ static inline int snd_seq_output_ok(struct snd_seq_pool *pool)
 	return snd_seq_pool_available(pool) >= pool->room;
 }
 
+/* number of cells to hold the ext data of the given length */
+static inline int var_cells(unsigned int len)
+{
+	return (len + sizeof(struct snd_seq_event) - 1) / sizeof(struct snd_seq_event);
+}
+
+/* max. number of cells moved between the pool and a per-CPU cache */
+#define SEQ_CACHE_BATCH		16
+
 /*
  * Variable length event:
  * The event like sysex uses variable length type.
@@ -168,6 +178,130 @@ static inline void free_cell(struct snd_seq_pool *pool,
 	atomic_dec(&pool->counter);
 }
 
+/* move up to count cells from one free list to another */
+static int move_cells(struct snd_seq_event_cell **to,
+		      struct snd_seq_event_cell **from, int count)
+{
+	struct snd_seq_event_cell *cell;
+	int moved;
+
+	for (moved = 0; moved < count && *from; moved++) {
+		cell = *from;
+		*from = cell->next;
+		cell->next = *to;
+		*to = cell;
+	}
+	return moved;
+}
+
+/* return cells of a cache to the pool; call with cache->lock held */
+static int flush_cache(struct snd_seq_pool *pool,
+		       struct snd_seq_pool_cache *cache, int keep)
+{
+	int moved;
+
+	if (cache->count <= keep)
+		return 0;
+	spin_lock(&pool->lock);
+	moved = move_cells(&pool->free, &cache->free, cache->count - keep);
+	spin_unlock(&pool->lock);
+	cache->count -= moved;
+	return moved;
+}
+
+/* return the cells of all caches to the pool */
+static int drain_caches(struct snd_seq_pool *pool)
+{
+	struct snd_seq_pool_cache *cache;
+	unsigned long flags;
+	int cpu, moved = 0;
+
+	for_each_possible_cpu(cpu) {
+		cache = per_cpu_ptr(pool->cache, cpu);
+		spin_lock_irqsave(&cache->lock, flags);
+		moved += flush_cache(pool, cache, 0);
+		spin_unlock_irqrestore(&cache->lock, flags);
+	}
+	return moved;
+}
+
+static inline void cache_free_cell(struct snd_seq_pool_cache *cache,
+				   struct snd_seq_event_cell *cell)
+{
+	cell->next = cache->free;
+	cache->free = cell;
+	cache->count++;
+	atomic_dec(&cell->pool->counter);
+}
+
+/* free the cell to the cache of this CPU */
+static void cache_free(struct snd_seq_pool *pool,
+		       struct snd_seq_event_cell *cell)
+{
+	struct snd_seq_pool_cache *cache;
+	struct snd_seq_event_cell *curp, *nextptr;
+	unsigned long flags;
+
+	/* being migrated meanwhile is harmless, the cache is locked */
+	cache = raw_cpu_ptr(pool->cache);
+	spin_lock_irqsave(&cache->lock, flags);
+	if (snd_seq_ev_is_variable(&cell->event) &&
+	    (cell->event.data.ext.len & SNDRV_SEQ_EXT_CHAINED)) {
+		for (curp = cell->event.data.ext.ptr; curp; curp = nextptr) {
+			nextptr = curp->next;
+			cache_free_cell(cache, curp);
+		}
+	}
+	cache_free_cell(cache, cell);
+	/* a waiter looks only at the pool, so hand everything over then */
+	if (wq_has_sleeper(&pool->output_sleep))
+		flush_cache(pool, cache, 0);
+	else if (cache->count > 2 * pool->batch)
+		flush_cache(pool, cache, pool->batch);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	if (waitqueue_active(&pool->output_sleep)) {
+		/* has enough space now? */
+		if (snd_seq_output_ok(pool))
+			wake_up(&pool->output_sleep);
+	}
+}
+
+/* allocate a cell from the cache of this CPU, refilled from the pool */
+static struct snd_seq_event_cell *cache_alloc(struct snd_seq_pool *pool)
+{
+	struct snd_seq_pool_cache *cache;
+	struct snd_seq_event_cell *cell = NULL;
+	unsigned long flags;
+	int used;
+
+	cache = raw_cpu_ptr(pool->cache);
+	spin_lock_irqsave(&cache->lock, flags);
+	/* snd_seq_pool_mark_closing() syncs with us via the cache lock */
+	if (READ_ONCE(pool->closing))
+		goto unlock;
+	if (!cache->free) {
+		spin_lock(&pool->lock);
+		cache->count += move_cells(&cache->free, &pool->free,
+					   pool->batch);
+		spin_unlock(&pool->lock);
+	}
+	cell = cache->free;
+	if (cell) {
+		cache->free = cell->next;
+		cache->count--;
+		used = atomic_inc_return(&pool->counter);
+		if (READ_ONCE(pool->max_used) < used)
+			WRITE_ONCE(pool->max_used, used);
+		cache->alloc_success++;
+		/* clear cell pointers */
+		cell->next = NULL;
+	}
+ unlock:
+	spin_unlock_irqrestore(&cache->lock, flags);
+	return cell;
+}
+
 void snd_seq_cell_free(struct snd_seq_event_cell * cell)
 {
 	unsigned long flags;
@@ -179,6 +313,17 @@ void snd_seq_cell_free(struct snd_seq_event_cell * cell)
 	if (snd_BUG_ON(!pool))
 		return;
 
+	if (cell->shared) {
+		atomic_sub(var_cells(cell->shared->len), &pool->counter);
+		snd_seq_shared_data_put(cell->shared);
+		cell->shared = NULL;
+	}
+
+	if (pool->batch) {
+		cache_free(pool, cell);
+		return;
+	}
+
 	spin_lock_irqsave(&pool->lock, flags);
 	free_cell(pool, cell);
 	if (snd_seq_ev_is_variable(&cell->event)) {
@@ -219,6 +364,16 @@ static int snd_seq_cell_alloc(struct snd_seq_pool *pool,
 
 	*cellp = NULL;
 
+	if (pool->batch) {
+		cell = cache_alloc(pool);
+		if (cell) {
+			*cellp = cell;
+			return 0;
+		}
+		/* the free cells may be held by the other CPUs */
+		drain_caches(pool);
+	}
+
 	init_waitqueue_entry(&wait, current);
 	spin_lock_irqsave(&pool->lock, flags);
 	if (pool->ptr == NULL) {	/* not initialized */
@@ -231,11 +386,16 @@ static int snd_seq_cell_alloc(struct snd_seq_pool *pool,
 		set_current_state(TASK_INTERRUPTIBLE);
 		add_wait_queue(&pool->output_sleep, &wait);
 		spin_unlock_irqrestore(&pool->lock, flags);
-		if (mutexp)
-			mutex_unlock(mutexp);
-		schedule();
-		if (mutexp)
-			mutex_lock(mutexp);
+		/* cells freed to a cache before we were queued */
+		if (pool->batch && drain_caches(pool)) {
+			__set_current_state(TASK_RUNNING);
+		} else {
+			if (mutexp)
+				mutex_unlock(mutexp);
+			schedule();
+			if (mutexp)
+				mutex_lock(mutexp);
+		}
 		spin_lock_irqsave(&pool->lock, flags);
 		remove_wait_queue(&pool->output_sleep, &wait);
 		/* interrupted? */
@@ -253,10 +413,9 @@ static int snd_seq_cell_alloc(struct snd_seq_pool *pool,
 	if (cell) {
 		int used;
 		pool->free = cell->next;
-		atomic_inc(&pool->counter);
-		used = atomic_read(&pool->counter);
-		if (pool->max_used < used)
-			pool->max_used = used;
+		used = atomic_inc_return(&pool->counter);
+		if (READ_ONCE(pool->max_used) < used)
+			WRITE_ONCE(pool->max_used, used);
 		pool->event_alloc_success++;
 		/* clear cell pointers */
 		cell->next = NULL;
@@ -290,7 +449,7 @@ int snd_seq_event_dup(struct snd_seq_pool *pool, struct snd_seq_event *event,
 	extlen = 0;
 	if (snd_seq_ev_is_variable(event)) {
 		extlen = event->data.ext.len & ~SNDRV_SEQ_EXT_MASK;
-		ncells = (extlen + sizeof(struct snd_seq_event) - 1) / sizeof(struct snd_seq_event);
+		ncells = var_cells(extlen);
 	}
 	if (ncells >= pool->total_elements)
 		return -ENOMEM;
@@ -301,6 +460,7 @@ int snd_seq_event_dup(struct snd_seq_pool *pool, struct snd_seq_event *event,
 
 	/* copy the event */
 	cell->event = *event;
+	cell->shared = NULL;
 
 	/* decompose */
 	if (snd_seq_ev_is_variable(event)) {
@@ -354,6 +514,76 @@ int snd_seq_event_dup(struct snd_seq_pool *pool, struct snd_seq_event *event,
 	snd_seq_cell_free(cell);
 	return err;
 }
+
+/*
+ * allocate the shared copy of the variable length data of an event;
+ * the returned object holds one reference for the caller.
+ */
+struct snd_seq_shared_data *
+snd_seq_shared_data_new(struct snd_seq_event *event, gfp_t gfp)
+{
+	struct snd_seq_shared_data *shared;
+	int len, err;
+
+	len = get_var_len(event);
+	if (len <= 0)
+		return NULL;
+	shared = kmalloc(struct_size(shared, data, len), gfp);
+	if (!shared)
+		return NULL;
+	err = snd_seq_expand_var_event(event, len, shared->data, 1, 0);
+	if (err != len) {
+		kfree(shared);
+		return NULL;
+	}
+	refcount_set(&shared->ref, 1);
+	shared->len = len;
+	return shared;
+}
+
+void snd_seq_shared_data_put(struct snd_seq_shared_data *shared)
+{
+	if (shared && refcount_dec_and_test(&shared->ref))
+		kfree(shared);
+}
+
+/*
+ * duplicate the event to a single cell referring to the shared data
+ * instead of decomposing it to chained cells; always non-blocking.
+ * The data is charged to the pool as if it were copied, so that a
+ * client not reading its events still pins no more than its pool size;
+ * if the charge doesn't fit, the data is copied to cells as usual.
+ */
+int snd_seq_event_dup_shared(struct snd_seq_pool *pool,
+			     struct snd_seq_event *event,
+			     struct snd_seq_shared_data *shared,
+			     struct snd_seq_event_cell **cellp)
+{
+	struct snd_seq_event_cell *cell;
+	int ncells, err;
+
+	*cellp = NULL;
+	ncells = var_cells(shared->len);
+	if (atomic_add_return(ncells, &pool->counter) >= pool->total_elements) {
+		atomic_sub(ncells, &pool->counter);
+		return snd_seq_event_dup(pool, event, cellp, 1, NULL, NULL);
+	}
+	err = snd_seq_cell_alloc(pool, &cell, 1, NULL, NULL);
+	if (err < 0) {
+		atomic_sub(ncells, &pool->counter);
+		return err;
+	}
+
+	cell->event = *event;
+	/* a plain kernel pointer, readers handle it like any other */
+	cell->event.data.ext.len = shared->len;
+	cell->event.data.ext.ptr = shared->data;
+	refcount_inc(&shared->ref);
+	cell->shared = shared;
+
+	*cellp = cell;
+	return 0;
+}
   
 
 /* poll wait */
@@ -393,10 +623,14 @@ int snd_seq_pool_init(struct snd_seq_pool *pool)
 	for (cell = 0; cell < pool->size; cell++) {
 		cellptr = pool->ptr + cell;
 		cellptr->pool = pool;
+		cellptr->shared = NULL;
 		cellptr->next = pool->free;
 		pool->free = cellptr;
 	}
 	pool->room = (pool->size + 1) / 2;
+	/* keep most of the cells in the pool even with all caches filled */
+	pool->batch = min_t(int, SEQ_CACHE_BATCH,
+			    pool->size / (4 * num_possible_cpus()));
 
 	/* init statistics */
 	pool->max_used = 0;
@@ -415,6 +649,8 @@ void snd_seq_pool_mark_closing(struct snd_seq_pool *pool)
 	spin_lock_irqsave(&pool->lock, flags);
 	pool->closing = 1;
 	spin_unlock_irqrestore(&pool->lock, flags);
+	/* this also waits for allocations in progress on the caches */
+	drain_caches(pool);
 }
 
 /* remove events */
@@ -431,12 +667,14 @@ int snd_seq_pool_done(struct snd_seq_pool *pool)
 
 	while (atomic_read(&pool->counter) > 0)
 		schedule_timeout_uninterruptible(1);
+	drain_caches(pool);
 	
 	/* release all resources */
 	spin_lock_irq(&pool->lock);
 	ptr = pool->ptr;
 	pool->ptr = NULL;
 	pool->free = NULL;
+	pool->batch = 0;
 	pool->total_elements = 0;
 	spin_unlock_irq(&pool->lock);
 
@@ -454,11 +692,19 @@ int snd_seq_pool_done(struct snd_seq_pool *pool)
 struct snd_seq_pool *snd_seq_pool_new(int poolsize)
 {
 	struct snd_seq_pool *pool;
+	int cpu;
 
 	/* create pool block */
 	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
 	if (!pool)
 		return NULL;
+	pool->cache = alloc_percpu(struct snd_seq_pool_cache);
+	if (!pool->cache) {
+		kfree(pool);
+		return NULL;
+	}
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(pool->cache, cpu)->lock);
 	spin_lock_init(&pool->lock);
 	pool->ptr = NULL;
 	pool->free = NULL;
@@ -484,6 +730,7 @@ int snd_seq_pool_delete(struct snd_seq_pool **ppool)
 		return 0;
 	snd_seq_pool_mark_closing(pool);
 	snd_seq_pool_done(pool);
+	free_percpu(pool->cache);
 	kfree(pool);
 	return 0;
 }
@@ -492,11 +739,16 @@ int snd_seq_pool_delete(struct snd_seq_pool **ppool)
 void snd_seq_info_pool(struct snd_info_buffer *buffer,
 		       struct snd_seq_pool *pool, char *space)
 {
+	int cpu, success;
+
 	if (pool == NULL)
 		return;
+	success = pool->event_alloc_success;
+	for_each_possible_cpu(cpu)
+		success += per_cpu_ptr(pool->cache, cpu)->alloc_success;
 	snd_iprintf(buffer, "%sPool size          : %d\n", space, pool->total_elements);
 	snd_iprintf(buffer, "%sCells in use       : %d\n", space, atomic_read(&pool->counter));
 	snd_iprintf(buffer, "%sPeak cells in use  : %d\n", space, pool->max_used);
-	snd_iprintf(buffer, "%sAlloc success      : %d\n", space, pool->event_alloc_success);
+	snd_iprintf(buffer, "%sAlloc success      : %d\n", space, success);
 	snd_iprintf(buffer, "%sAlloc failures     : %d\n", space, pool->event_alloc_failures);
 }
@@ -8,14 +8,26 @@
 
 #include <sound/seq_kernel.h>
 #include <linux/poll.h>
+#include <linux/rbtree.h>
+#include <linux/refcount.h>
 
 struct snd_info_buffer;
 
+/* variable length data shared by the cells of a multi-destination delivery */
+struct snd_seq_shared_data {
+	refcount_t ref;
+	unsigned int len;
+	char data[];
+};
+
 /* container for sequencer event (internal use) */
 struct snd_seq_event_cell {
 	struct snd_seq_event event;
 	struct snd_seq_pool *pool;				/* used pool */
+	struct snd_seq_shared_data *shared;	/* referred ext data, if any */
 	struct snd_seq_event_cell *next;	/* next cell */
+	struct rb_node node;			/* node in prioq */
+	unsigned int order;			/* insertion order in prioq */
 };
 
 /* design note: the pool is a contiguous block of memory, if we dynamicly
@@ -23,12 +35,22 @@ struct snd_seq_event_cell {
    pool as we need to know the base address of the pool when releasing
    memory. */
 
+/* per-CPU stock of free cells, exchanged in batches with the pool */
+struct snd_seq_pool_cache {
+	spinlock_t lock;
+	struct snd_seq_event_cell *free;	/* free cells of this CPU */
+	int count;		/* number of cells on the free list */
+	int alloc_success;
+};
+
 struct snd_seq_pool {
 	struct snd_seq_event_cell *ptr;	/* pointer to first event chunk */
 	struct snd_seq_event_cell *free;	/* pointer to the head of the free list */
+	struct snd_seq_pool_cache __percpu *cache;
+	int batch;		/* cells moved to/from a cache at once, 0 = off */
 
 	int total_elements;	/* pool size actually allocated */
-	atomic_t counter;	/* cells free */
+	atomic_t counter;	/* cells used, incl. charged shared data */
 
 	int size;		/* pool size to be allocated */
 	int room;		/* watermark for sleep/wakeup */
@@ -53,6 +75,14 @@ void snd_seq_cell_free(struct snd_seq_event_cell *cell);
 int snd_seq_event_dup(struct snd_seq_pool *pool, struct snd_seq_event *event,
 		      struct snd_seq_event_cell **cellp, int nonblock,
 		      struct file *file, struct mutex *mutexp);
+int snd_seq_event_dup_shared(struct snd_seq_pool *pool,
+			     struct snd_seq_event *event,
+			     struct snd_seq_shared_data *shared,
+			     struct snd_seq_event_cell **cellp);
+
+struct snd_seq_shared_data *
+snd_seq_shared_data_new(struct snd_seq_event *event, gfp_t gfp);
+void snd_seq_shared_data_put(struct snd_seq_shared_data *shared);
 
 /* return number of unused (free) cells */
 static inline int snd_seq_unused_cells(struct snd_seq_pool *pool)
@@ -11,28 +11,16 @@
 #include "seq_prioq.h"
 
 
-/* Implementation is a simple linked list for now...
+/* Implementation is a red-black tree of cells.
 
    This priority queue orders the events on timestamp. For events with an
-   equeal timestamp the queue behaves as a FIFO. 
-
-   *
-   *           +-------+
-   *  Head --> | first |
-   *           +-------+
-   *                 |next
-   *           +-----v-+
-   *           |       |
-   *           +-------+
-   *                 |
-   *           +-----v-+
-   *           |       |
-   *           +-------+
-   *                 |
-   *           +-----v-+
-   *  Tail --> | last  |
-   *           +-------+
-   *
+   equeal timestamp the queue behaves as a FIFO, except that high priority
+   events are put in front of the others (the latest one first).
+
+   The leftmost cell (the next one to dispatch) is cached, and the tail
+   is tracked so that ordered data can be appended without a walk. This
+   is very likely if a sequencer application or midi file player is
+   feeding us (sequential) data. Other insertions take O(log n).
 
  */
 
@@ -48,7 +36,7 @@ struct snd_seq_prioq *snd_seq_prioq_new(void)
 		return NULL;
 	
 	spin_lock_init(&f->lock);
-	f->head = NULL;
+	f->root = RB_ROOT_CACHED;
 	f->tail = NULL;
 	f->cells = 0;
 	
@@ -81,20 +69,6 @@ void snd_seq_prioq_delete(struct snd_seq_prioq **fifo)
 
 
 
-/* compare timestamp between events */
-/* return 1 if a >= b; 0 */
-static inline int compare_timestamp(struct snd_seq_event *a,
-				    struct snd_seq_event *b)
-{
-	if ((a->flags & SNDRV_SEQ_TIME_STAMP_MASK) == SNDRV_SEQ_TIME_STAMP_TICK) {
-		/* compare ticks */
-		return (snd_seq_compare_tick_time(&a->time.tick, &b->time.tick));
-	} else {
-		/* compare real time */
-		return (snd_seq_compare_real_time(&a->time.time, &b->time.time));
-	}
-}
-
 /* compare timestamp between events */
 /* return negative if a < b;
  *        zero     if a = b;
@@ -127,72 +101,79 @@ static inline int compare_timestamp_rel(struct snd_seq_event *a,
 	}
 }
 
+/* compare the dispatch order of cells */
+/* return negative if a goes before b, positive otherwise */
+static int compare_cells(struct snd_seq_event_cell *a,
+			 struct snd_seq_event_cell *b)
+{
+	int rel = compare_timestamp_rel(&a->event, &b->event);
+	int prior;
+
+	if (rel)
+		return rel;
+	prior = a->event.flags & SNDRV_SEQ_PRIORITY_MASK;
+	if (prior != (b->event.flags & SNDRV_SEQ_PRIORITY_MASK))
+		return prior ? -1 : 1;
+	/* equal priorities: the order counter may wrap around */
+	rel = (int)(a->order - b->order);
+	return prior ? -rel : rel;
+}
+
+/* unlink cell from prioq; call with the lock held */
+static void prioq_erase(struct snd_seq_prioq *f,
+			struct snd_seq_event_cell *cell)
+{
+	struct rb_node *prev;
+
+	if (f->tail == cell) {
+		prev = rb_prev(&cell->node);
+		f->tail = prev ? rb_entry(prev, struct snd_seq_event_cell, node)
+			       : NULL;
+	}
+	rb_erase_cached(&cell->node, &f->root);
+	f->cells--;
+}
+
 /* enqueue cell to prioq */
 int snd_seq_prioq_cell_in(struct snd_seq_prioq * f,
 			  struct snd_seq_event_cell * cell)
 {
-	struct snd_seq_event_cell *cur, *prev;
+	struct rb_node **link, *parent;
+	struct snd_seq_event_cell *cur;
+	bool leftmost = true, rightmost = true;
 	unsigned long flags;
-	int count;
-	int prior;
 
 	if (snd_BUG_ON(!f || !cell))
 		return -EINVAL;
 	
-	/* check flags */
-	prior = (cell->event.flags & SNDRV_SEQ_PRIORITY_MASK);
-
 	spin_lock_irqsave(&f->lock, flags);
+	cell->order = f->order++;
 
 	/* check if this element needs to inserted at the end (ie. ordered 
-	   data is inserted) This will be very likeley if a sequencer 
-	   application or midi file player is feeding us (sequential) data */
-	if (f->tail && !prior) {
-		if (compare_timestamp(&cell->event, &f->tail->event)) {
-			/* add new cell to tail of the fifo */
-			f->tail->next = cell;
-			f->tail = cell;
-			cell->next = NULL;
-			f->cells++;
-			spin_unlock_irqrestore(&f->lock, flags);
-			return 0;
-		}
-	}
-	/* traverse list of elements to find the place where the new cell is
-	   to be inserted... Note that this is a order n process ! */
-
-	prev = NULL;		/* previous cell */
-	cur = f->head;		/* cursor */
-
-	count = 10000; /* FIXME: enough big, isn't it? */
-	while (cur != NULL) {
-		/* compare timestamps */
-		int rel = compare_timestamp_rel(&cell->event, &cur->event);
-		if (rel < 0)
-			/* new cell has earlier schedule time, */
-			break;
-		else if (rel == 0 && prior)
-			/* equal schedule time and prior to others */
-			break;
-		/* new cell has equal or larger schedule time, */
-		/* move cursor to next cell */
-		prev = cur;
-		cur = cur->next;
-		if (! --count) {
-			spin_unlock_irqrestore(&f->lock, flags);
-			pr_err("ALSA: seq: cannot find a pointer.. infinite loop?\n");
-			return -EINVAL;
+	   data is inserted); the tail never has a right child */
+	if (f->tail && compare_cells(cell, f->tail) > 0) {
+		parent = &f->tail->node;
+		link = &parent->rb_right;
+		leftmost = false;
+	} else {
+		parent = NULL;
+		link = &f->root.rb_root.rb_node;
+		while (*link) {
+			parent = *link;
+			cur = rb_entry(parent, struct snd_seq_event_cell, node);
+			if (compare_cells(cell, cur) < 0) {
+				link = &parent->rb_left;
+				rightmost = false;
+			} else {
+				link = &parent->rb_right;
+				leftmost = false;
+			}
 		}
 	}
 
-	/* insert it before cursor */
-	if (prev != NULL)
-		prev->next = cell;
-	cell->next = cur;
-
-	if (f->head == cur) /* this is the first cell, set head to it */
-		f->head = cell;
-	if (cur == NULL) /* reached end of the list */
+	rb_link_node(&cell->node, parent, link);
+	rb_insert_color_cached(&cell->node, &f->root, leftmost);
+	if (rightmost)
 		f->tail = cell;
 	f->cells++;
 	spin_unlock_irqrestore(&f->lock, flags);
@@ -212,7 +193,8 @@ static int event_is_ready(struct snd_seq_event *ev, void *current_time)
 struct snd_seq_event_cell *snd_seq_prioq_cell_out(struct snd_seq_prioq *f,
 						  void *current_time)
 {
-	struct snd_seq_event_cell *cell;
+	struct snd_seq_event_cell *cell = NULL;
+	struct rb_node *node;
 	unsigned long flags;
 
 	if (f == NULL) {
@@ -221,18 +203,14 @@ struct snd_seq_event_cell *snd_seq_prioq_cell_out(struct snd_seq_prioq *f,
 	}
 	spin_lock_irqsave(&f->lock, flags);
 
-	cell = f->head;
+	node = rb_first_cached(&f->root);
+	if (node)
+		cell = rb_entry(node, struct snd_seq_event_cell, node);
 	if (cell && current_time && !event_is_ready(&cell->event, current_time))
 		cell = NULL;
 	if (cell) {
-		f->head = cell->next;
-
-		/* reset tail if this was the last element */
-		if (f->tail == cell)
-			f->tail = NULL;
-
+		prioq_erase(f, cell);
 		cell->next = NULL;
-		f->cells--;
 	}
 
 	spin_unlock_irqrestore(&f->lock, flags);
@@ -274,26 +252,19 @@ static inline int prioq_match(struct snd_seq_event_cell *cell,
 /* remove cells for left client */
 void snd_seq_prioq_leave(struct snd_seq_prioq * f, int client, int timestamp)
 {
-	register struct snd_seq_event_cell *cell, *next;
+	struct snd_seq_event_cell *cell;
+	struct rb_node *node, *next;
 	unsigned long flags;
-	struct snd_seq_event_cell *prev = NULL;
 	struct snd_seq_event_cell *freefirst = NULL, *freeprev = NULL, *freenext;
 
 	/* collect all removed cells */
 	spin_lock_irqsave(&f->lock, flags);
-	cell = f->head;
-	while (cell) {
-		next = cell->next;
+	for (node = rb_first_cached(&f->root); node; node = next) {
+		next = rb_next(node);
+		cell = rb_entry(node, struct snd_seq_event_cell, node);
 		if (prioq_match(cell, client, timestamp)) {
 			/* remove cell from prioq */
-			if (cell == f->head) {
-				f->head = cell->next;
-			} else {
-				prev->next = cell->next;
-			}
-			if (cell == f->tail)
-				f->tail = cell->next;
-			f->cells--;
+			prioq_erase(f, cell);
 			/* add cell to free list */
 			cell->next = NULL;
 			if (freefirst == NULL) {
@@ -311,9 +282,7 @@ void snd_seq_prioq_leave(struct snd_seq_prioq * f, int client, int timestamp)
 				cell->event.dest.client,
 				client);
 #endif
-			prev = cell;
 		}
-		cell = next;		
 	}
 	spin_unlock_irqrestore(&f->lock, flags);	
 
@@ -384,30 +353,21 @@ static int prioq_remove_match(struct snd_seq_remove_events *info,
 void snd_seq_prioq_remove_events(struct snd_seq_prioq * f, int client,
 				 struct snd_seq_remove_events *info)
 {
-	struct snd_seq_event_cell *cell, *next;
+	struct snd_seq_event_cell *cell;
+	struct rb_node *node, *next;
 	unsigned long flags;
-	struct snd_seq_event_cell *prev = NULL;
 	struct snd_seq_event_cell *freefirst = NULL, *freeprev = NULL, *freenext;
 
 	/* collect all removed cells */
 	spin_lock_irqsave(&f->lock, flags);
-	cell = f->head;
-
-	while (cell) {
-		next = cell->next;
+	for (node = rb_first_cached(&f->root); node; node = next) {
+		next = rb_next(node);
+		cell = rb_entry(node, struct snd_seq_event_cell, node);
 		if (cell->event.source.client == client &&
 			prioq_remove_match(info, &cell->event)) {
 
 			/* remove cell from prioq */
-			if (cell == f->head) {
-				f->head = cell->next;
-			} else {
-				prev->next = cell->next;
-			}
-
-			if (cell == f->tail)
-				f->tail = cell->next;
-			f->cells--;
+			prioq_erase(f, cell);
 
 			/* add cell to free list */
 			cell->next = NULL;
@@ -418,10 +378,7 @@ void snd_seq_prioq_remove_events(struct snd_seq_prioq * f, int client,
 			}
 
 			freeprev = cell;
-		} else {
-			prev = cell;
 		}
-		cell = next;		
 	}
 	spin_unlock_irqrestore(&f->lock, flags);	
 
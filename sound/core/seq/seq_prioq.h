@@ -12,8 +12,9 @@
 /* === PRIOQ === */
 
 struct snd_seq_prioq {
-	struct snd_seq_event_cell *head;      /* pointer to head of prioq */
+	struct rb_root_cached root;	      /* cells sorted by timestamp */
 	struct snd_seq_event_cell *tail;      /* pointer to tail of prioq */
+	unsigned int order;		      /* insertion counter */
 	int cells;
 	spinlock_t lock;
 };
@@ -42,4 +43,12 @@ void snd_seq_prioq_leave(struct snd_seq_prioq *f, int client, int timestamp);
 void snd_seq_prioq_remove_events(struct snd_seq_prioq *f, int client,
 				 struct snd_seq_remove_events *info);
 
+#ifdef CONFIG_SND_SEQ_PRIOQ_KUNIT_TEST
+int snd_seq_prioq_test_init(void);
+void snd_seq_prioq_test_exit(void);
+#else
+static inline int snd_seq_prioq_test_init(void) { return 0; }
+static inline void snd_seq_prioq_test_exit(void) {}
+#endif
+
 #endif
@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *  KUnit tests of the ALSA sequencer priority queue
+ *
+ *  A deep backlog of tick-stamped cells is queued in ascending, descending
+ *  and random order, then drained again; the cells must come out sorted
+ *  by time and in queueing order among equal times.  The average cost of
+ *  an insert and a removal is reported.
+ */
+
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <sound/core.h>
+#include "seq_prioq.h"
+
+#define TEST_CELLS	4096
+
+enum {
+	TEST_ASCENDING,
+	TEST_DESCENDING,
+	TEST_RANDOM,
+};
+
+static const char * const test_order_names[] = {
+	[TEST_ASCENDING] = "ascending",
+	[TEST_DESCENDING] = "descending",
+	[TEST_RANDOM] = "random",
+};
+
+static void test_prioq_backlog(struct kunit *test, int order)
+{
+	struct snd_seq_event_cell *cells, *cell, *prev = NULL;
+	struct snd_seq_prioq *f;
+	unsigned int i, count = 0, seed = 1;
+	u64 in_ns, out_ns;
+	int err = 0;
+
+	cells = kunit_kzalloc(test, TEST_CELLS * sizeof(*cells), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, cells);
+	for (i = 0; i < TEST_CELLS; i++) {
+		cells[i].event.flags = SNDRV_SEQ_TIME_STAMP_TICK;
+		switch (order) {
+		case TEST_ASCENDING:
+			cells[i].event.time.tick = i;
+			break;
+		case TEST_DESCENDING:
+			cells[i].event.time.tick = TEST_CELLS - i;
+			break;
+		default:
+			/* narrow range, so that equal times are common */
+			seed = seed * 1103515245 + 12345;
+			cells[i].event.time.tick = (seed >> 16) % (TEST_CELLS / 4);
+			break;
+		}
+	}
+	f = snd_seq_prioq_new();
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, f);
+
+	in_ns = ktime_get_ns();
+	for (i = 0; i < TEST_CELLS; i++) {
+		err = snd_seq_prioq_cell_in(f, &cells[i]);
+		if (err < 0)
+			break;
+	}
+	in_ns = ktime_get_ns() - in_ns;
+	KUNIT_EXPECT_EQ(test, err, 0);
+	KUNIT_EXPECT_EQ(test, snd_seq_prioq_avail(f), (int)i);
+
+	out_ns = ktime_get_ns();
+	while ((cell = snd_seq_prioq_cell_out(f, NULL)) != NULL) {
+		if (prev && (cell->event.time.tick < prev->event.time.tick ||
+			     (cell->event.time.tick == prev->event.time.tick &&
+			      cell < prev)))
+			err = -EINVAL;
+		prev = cell;
+		count++;
+	}
+	out_ns = ktime_get_ns() - out_ns;
+	KUNIT_EXPECT_EQ(test, err, 0);
+	KUNIT_EXPECT_EQ(test, count, i);
+	KUNIT_EXPECT_EQ(test, snd_seq_prioq_avail(f), 0);
+	snd_seq_prioq_delete(&f);
+
+	kunit_info(test, "%u cells %s: cell_in %llu ns, cell_out %llu ns\n",
+		   TEST_CELLS, test_order_names[order],
+		   div_u64(in_ns, TEST_CELLS), div_u64(out_ns, TEST_CELLS));
+}
+
+static void test_prioq_ascending(struct kunit *test)
+{
+	test_prioq_backlog(test, TEST_ASCENDING);
+}
+
+static void test_prioq_descending(struct kunit *test)
+{
+	test_prioq_backlog(test, TEST_DESCENDING);
+}
+
+static void test_prioq_random(struct kunit *test)
+{
+	test_prioq_backlog(test, TEST_RANDOM);
+}
+
+static struct kunit_case snd_seq_prioq_test_cases[] = {
+	KUNIT_CASE(test_prioq_ascending),
+	KUNIT_CASE(test_prioq_descending),
+	KUNIT_CASE(test_prioq_random),
+	{}
+};
+
+static struct kunit_suite snd_seq_prioq_test_suite = {
+	.name = "snd-seq-prioq",
+	.test_cases = snd_seq_prioq_test_cases,
+};
+
+static struct kunit_suite *snd_seq_prioq_test_suites[] = {
+	&snd_seq_prioq_test_suite, NULL
+};
+
+/* called from the module init, as the prioq is internal to it */
+int snd_seq_prioq_test_init(void)
+{
+	return __kunit_test_suites_init(snd_seq_prioq_test_suites);
+}
+
+void snd_seq_prioq_test_exit(void)
+{
+	__kunit_test_suites_exit(snd_seq_prioq_test_suites);
+}
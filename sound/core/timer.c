@@ -13,6 +13,9 @@
 #include <linux/module.h>
 #include <linux/string.h>
 #include <linux/sched/signal.h>
+#include <linux/vmalloc.h>
+#include <linux/eventfd.h>
+#include <linux/log2.h>
 #include <sound/core.h>
 #include <sound/timer.h>
 #include <sound/control.h>
@@ -78,6 +81,11 @@ struct snd_timer_user {
 	bool disconnected;
 	struct snd_timer_read *queue;
 	struct snd_timer_tread64 *tqueue;
+	/* mmapped event ring, replaces tqueue when set */
+	struct snd_timer_ring_header *ring;
+	unsigned int ring_size;
+	u32 ring_head;		/* kernel copy, the mapped one is untrusted */
+	struct eventfd_ctx *ring_eventfd;
 	spinlock_t qlock;
 	unsigned long last_resolution;
 	unsigned int filter;
@@ -1350,9 +1358,32 @@ static void snd_timer_user_interrupt(struct snd_timer_instance *timeri,
 	wake_up(&tu->qchange_sleep);
 }
 
+/* single producer, serialized by qlock; the consumer is user space */
+static void snd_timer_user_append_to_ring(struct snd_timer_user *tu,
+					  struct snd_timer_tread64 *tread)
+{
+	struct snd_timer_ring_header *ring = tu->ring;
+	struct snd_timer_tread64 *records =
+		(void *)ring + SNDRV_TIMER_RING_HEADER_SIZE;
+	u32 tail = smp_load_acquire(&ring->tail);
+
+	/* also catches a bogus tail written by the application */
+	if (tu->ring_head - tail >= tu->ring_size) {
+		tu->overrun++;
+		WRITE_ONCE(ring->overrun, tu->overrun);
+		return;
+	}
+	records[tu->ring_head & (tu->ring_size - 1)] = *tread;
+	smp_store_release(&ring->head, ++tu->ring_head);
+}
+
 static void snd_timer_user_append_to_tqueue(struct snd_timer_user *tu,
 					    struct snd_timer_tread64 *tread)
 {
+	if (tu->ring) {
+		snd_timer_user_append_to_ring(tu, tread);
+		return;
+	}
 	if (tu->qused >= tu->queue_size) {
 		tu->overrun++;
 	} else {
@@ -1384,6 +1415,8 @@ static void snd_timer_user_ccallback(struct snd_timer_instance *timeri,
 	spin_lock_irqsave(&tu->qlock, flags);
 	snd_timer_user_append_to_tqueue(tu, &r1);
 	spin_unlock_irqrestore(&tu->qlock, flags);
+	if (tu->ring_eventfd)
+		eventfd_signal(tu->ring_eventfd, 1);
 	kill_fasync(&tu->fasync, SIGIO, POLL_IN);
 	wake_up(&tu->qchange_sleep);
 }
@@ -1433,7 +1466,8 @@ static void snd_timer_user_tinterrupt(struct snd_timer_instance *timeri,
 		goto __wake;
 	if (ticks == 0)
 		goto __wake;
-	if (tu->qused > 0) {
+	/* records published to the ring can't be merged into any longer */
+	if (!tu->ring && tu->qused > 0) {
 		prev = tu->qtail == 0 ? tu->queue_size - 1 : tu->qtail - 1;
 		r = &tu->tqueue[prev];
 		if (r->event == SNDRV_TIMER_EVENT_TICK) {
@@ -1454,6 +1488,8 @@ static void snd_timer_user_tinterrupt(struct snd_timer_instance *timeri,
 	spin_unlock(&tu->qlock);
 	if (append == 0)
 		return;
+	if (tu->ring_eventfd)
+		eventfd_signal(tu->ring_eventfd, 1);
 	kill_fasync(&tu->fasync, SIGIO, POLL_IN);
 	wake_up(&tu->qchange_sleep);
 }
@@ -1524,6 +1560,9 @@ static int snd_timer_user_release(struct inode *inode, struct file *file)
 		mutex_unlock(&tu->ioctl_lock);
 		kfree(tu->queue);
 		kfree(tu->tqueue);
+		vfree(tu->ring);
+		if (tu->ring_eventfd)
+			eventfd_ctx_put(tu->ring_eventfd);
 		kfree(tu);
 	}
 	return 0;
@@ -2040,7 +2079,7 @@ static int snd_timer_user_tread(void __user *argp, struct snd_timer_user *tu,
 	int __user *p = argp;
 	int xarg, old_tread;
 
-	if (tu->timeri)	/* too late */
+	if (tu->timeri || tu->ring)	/* too late */
 		return -EBUSY;
 	if (get_user(xarg, p))
 		return -EFAULT;
@@ -2064,6 +2103,49 @@ static int snd_timer_user_tread(void __user *argp, struct snd_timer_user *tu,
 	return 0;
 }
 
+static int snd_timer_user_ring(struct snd_timer_user *tu,
+			       struct snd_timer_ring_params __user *_params)
+{
+	struct snd_timer_ring_params params;
+	struct snd_timer_ring_header *ring;
+	struct eventfd_ctx *efd = NULL;
+	size_t bytes;
+
+	if (tu->timeri || tu->ring)	/* too late */
+		return -EBUSY;
+	if (tu->tread != TREAD_FORMAT_TIME64)
+		return -EINVAL;
+	if (copy_from_user(&params, _params, sizeof(params)))
+		return -EFAULT;
+	if (params.size < 32 || params.size > 65536 ||
+	    !is_power_of_2(params.size))
+		return -EINVAL;
+
+	if (params.eventfd >= 0) {
+		efd = eventfd_ctx_fdget(params.eventfd);
+		if (IS_ERR(efd))
+			return PTR_ERR(efd);
+	}
+
+	bytes = SNDRV_TIMER_RING_HEADER_SIZE +
+		params.size * sizeof(struct snd_timer_tread64);
+	ring = vmalloc_user(PAGE_ALIGN(bytes));
+	if (!ring) {
+		if (efd)
+			eventfd_ctx_put(efd);
+		return -ENOMEM;
+	}
+	ring->size = params.size;
+
+	spin_lock_irq(&tu->qlock);
+	tu->ring = ring;
+	tu->ring_size = params.size;
+	tu->ring_head = 0;
+	tu->ring_eventfd = efd;
+	spin_unlock_irq(&tu->qlock);
+	return 0;
+}
+
 enum {
 	SNDRV_TIMER_IOCTL_START_OLD = _IO('T', 0x20),
 	SNDRV_TIMER_IOCTL_STOP_OLD = _IO('T', 0x21),
@@ -2087,6 +2169,8 @@ static long __snd_timer_user_ioctl(struct file *file, unsigned int cmd,
 	case SNDRV_TIMER_IOCTL_TREAD_OLD:
 	case SNDRV_TIMER_IOCTL_TREAD64:
 		return snd_timer_user_tread(argp, tu, cmd, compat);
+	case SNDRV_TIMER_IOCTL_RING:
+		return snd_timer_user_ring(tu, argp);
 	case SNDRV_TIMER_IOCTL_GINFO:
 		return snd_timer_user_ginfo(file, argp);
 	case SNDRV_TIMER_IOCTL_GPARAMS:
@@ -2150,6 +2234,9 @@ static ssize_t snd_timer_user_read(struct file *file, char __user *buffer,
 	int err = 0;
 
 	tu = file->private_data;
+	/* the events go to the mmapped ring */
+	if (tu->ring)
+		return -EBADFD;
 	switch (tu->tread) {
 	case TREAD_FORMAT_TIME64:
 		unit = sizeof(struct snd_timer_tread64);
@@ -2256,8 +2343,12 @@ static __poll_t snd_timer_user_poll(struct file *file, poll_table * wait)
 
 	mask = 0;
 	spin_lock_irq(&tu->qlock);
-	if (tu->qused)
+	if (tu->ring) {
+		if (tu->ring_head != READ_ONCE(tu->ring->tail))
+			mask |= EPOLLIN | EPOLLRDNORM;
+	} else if (tu->qused) {
 		mask |= EPOLLIN | EPOLLRDNORM;
+	}
 	if (tu->disconnected)
 		mask |= EPOLLERR;
 	spin_unlock_irq(&tu->qlock);
@@ -2265,6 +2356,24 @@ static __poll_t snd_timer_user_poll(struct file *file, poll_table * wait)
 	return mask;
 }
 
+static int snd_timer_user_mmap(struct file *file, struct vm_area_struct *area)
+{
+	struct snd_timer_user *tu = file->private_data;
+	int err;
+
+	mutex_lock(&tu->ioctl_lock);
+	if (!tu->ring) {
+		err = -ENXIO;
+	} else if (area->vm_pgoff) {
+		err = -EINVAL;
+	} else {
+		area->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+		err = remap_vmalloc_range(area, tu->ring, 0);
+	}
+	mutex_unlock(&tu->ioctl_lock);
+	return err;
+}
+
 #ifdef CONFIG_COMPAT
 #include "timer_compat.c"
 #else
@@ -2279,6 +2388,7 @@ static const struct file_operations snd_timer_f_ops =
 	.release =	snd_timer_user_release,
 	.llseek =	no_llseek,
 	.poll =		snd_timer_user_poll,
+	.mmap =		snd_timer_user_mmap,
 	.unlocked_ioctl =	snd_timer_user_ioctl,
 	.compat_ioctl =	snd_timer_user_ioctl_compat,
 	.fasync = 	snd_timer_user_fasync,
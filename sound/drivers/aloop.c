@@ -17,8 +17,12 @@
 
 #include <linux/init.h>
 #include <linux/jiffies.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/vmalloc.h>
 #include <linux/wait.h>
 #include <linux/module.h>
 #include <linux/platform_device.h>
@@ -43,6 +47,7 @@ static bool enable[SNDRV_CARDS] = {1, [1 ... (SNDRV_CARDS - 1)] = 0};
 static int pcm_substreams[SNDRV_CARDS] = {[0 ... (SNDRV_CARDS - 1)] = 8};
 static int pcm_notify[SNDRV_CARDS];
 static char *timer_source[SNDRV_CARDS];
+static bool shared_buffer[SNDRV_CARDS];
 
 module_param_array(index, int, NULL, 0444);
 MODULE_PARM_DESC(index, "Index value for loopback soundcard.");
@@ -55,10 +60,19 @@ MODULE_PARM_DESC(pcm_substreams, "PCM substreams # (1-8) for loopback driver.");
 module_param_array(pcm_notify, int, NULL, 0444);
 MODULE_PARM_DESC(pcm_notify, "Break capture when PCM format/rate/channels changes.");
 module_param_array(timer_source, charp, NULL, 0444);
-MODULE_PARM_DESC(timer_source, "Sound card name or number and device/subdevice number of timer to be used. Empty string for jiffies timer [default].");
+MODULE_PARM_DESC(timer_source, "Sound card name or number and device/subdevice number of timer to be used, \"hrtimer\" for the high resolution timer. Empty string for jiffies timer [default].");
+module_param_array(shared_buffer, bool, NULL, 0444);
+MODULE_PARM_DESC(shared_buffer, "Let playback and capture of a cable share one buffer instead of copying; playback stays at most one buffer ahead of the capture reader.");
 
 #define NO_PITCH 100000
 
+/* timer_source value selecting the hrtimer mode */
+#define HRTIMER_SOURCE	"hrtimer"
+/* ring between playback and capture in hrtimer mode; it has to hold
+ * a full capture period, see period_bytes_max
+ */
+#define LOOPBACK_RING_SIZE	(2 * 1024 * 1024)
+
 #define CABLE_VALID_PLAYBACK	BIT(SNDRV_PCM_STREAM_PLAYBACK)
 #define CABLE_VALID_CAPTURE	BIT(SNDRV_PCM_STREAM_CAPTURE)
 #define CABLE_VALID_BOTH	(CABLE_VALID_PLAYBACK | CABLE_VALID_CAPTURE)
@@ -91,6 +105,10 @@ struct loopback_ops {
 	 * call in cable->lock
 	 */
 	unsigned int (*pos_update)(struct loopback_cable *cable);
+	/* optional, replaces pos_update
+	 * call in the PCM stream lock, without cable->lock
+	 */
+	snd_pcm_uframes_t (*pointer)(struct loopback_pcm *dpcm);
 	/* optional */
 	void (*dpcm_info)(struct loopback_pcm *dpcm,
 			  struct snd_info_buffer *buffer);
@@ -113,6 +131,23 @@ struct loopback_cable {
 		struct work_struct event_work;
 		struct snd_timer_instance *instance;
 	} snd_timer;
+	/* If hrtimer is used: the playback side is the only writer of
+	 * head, the capture side the only writer of tail
+	 */
+	struct {
+		char *buf;
+		unsigned int head;
+		unsigned int tail;
+		unsigned int overruns;
+	} ring;
+	/* If the buffer is shared: the capture side reads the playback
+	 * data in place once both sides use it (users == 2)
+	 */
+	struct {
+		void *area;
+		unsigned int bytes;
+		unsigned int users;
+	} shared;
 };
 
 struct loopback_setup {
@@ -134,6 +169,7 @@ struct loopback {
 	struct snd_pcm *pcm[2];
 	struct loopback_setup setup[MAX_PCM_SUBSTREAMS][2];
 	const char *timer_source;
+	bool shared_buffer;
 };
 
 struct loopback_pcm {
@@ -150,6 +186,9 @@ struct loopback_pcm {
 	unsigned int pcm_rate_shift;	/* rate shift value */
 	/* flags */
 	unsigned int period_update_pending :1;
+	unsigned int shared :1;		/* uses cable->shared.area */
+	unsigned int shared_pos;	/* last buf_pos seen by the pointer */
+	unsigned int shared_lag;	/* bytes the pointer is held back */
 	/* timer stuff */
 	unsigned int irq_pos;		/* fractional IRQ position in jiffies
 					 * ticks
@@ -159,6 +198,13 @@ struct loopback_pcm {
 	unsigned long last_jiffies;
 	/* If jiffies timer is used */
 	struct timer_list timer;
+	/* If hrtimer is used */
+	struct hrtimer hrtimer;
+	atomic_t hr_running;
+	ktime_t hr_base;		/* start of the current rate interval */
+	u64 hr_frames;			/* frames passed since hr_base */
+	unsigned int hr_rate;		/* pitched rate in mHz */
+	unsigned int hr_period_pos;	/* bytes since last period update */
 };
 
 static struct platform_device *devices[SNDRV_CARDS];
@@ -204,6 +250,12 @@ static inline unsigned int get_rate_shift(struct loopback_pcm *dpcm)
 	return get_setup(dpcm)->rate_shift;
 }
 
+/* both sides work on the same buffer, so there is nothing to copy */
+static inline bool cable_shared(struct loopback_cable *cable)
+{
+	return READ_ONCE(cable->shared.users) == 2;
+}
+
 /* call in cable->lock */
 static int loopback_jiffies_timer_start(struct loopback_pcm *dpcm)
 {
@@ -380,6 +432,7 @@ static int loopback_trigger(struct snd_pcm_substream *substream, int cmd)
 	struct snd_pcm_runtime *runtime = substream->runtime;
 	struct loopback_pcm *dpcm = runtime->private_data;
 	struct loopback_cable *cable = dpcm->cable;
+	struct loopback_pcm *play;
 	int err = 0, stream = 1 << substream->stream;
 
 	switch (cmd) {
@@ -391,6 +444,13 @@ static int loopback_trigger(struct snd_pcm_substream *substream, int cmd)
 		dpcm->pcm_rate_shift = 0;
 		dpcm->last_drift = 0;
 		spin_lock(&cable->lock);	
+		/* on a shared buffer, capture from where the playback is */
+		if (substream->stream == SNDRV_PCM_STREAM_CAPTURE &&
+		    cable_shared(cable) &&
+		    (cable->running & (1 << SNDRV_PCM_STREAM_PLAYBACK))) {
+			play = cable->streams[SNDRV_PCM_STREAM_PLAYBACK];
+			dpcm->buf_pos = READ_ONCE(play->buf_pos);
+		}
 		cable->running |= stream;
 		cable->pause &= ~stream;
 		err = cable->ops->start(dpcm);
@@ -474,13 +534,19 @@ static int loopback_prepare(struct snd_pcm_substream *substream)
 	dpcm->buf_pos = 0;
 	dpcm->pcm_buffer_size = frames_to_bytes(runtime, runtime->buffer_size);
 	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE) {
-		/* clear capture buffer */
+		/* clear capture buffer, unless it holds the playback data */
 		dpcm->silent_size = dpcm->pcm_buffer_size;
-		snd_pcm_format_set_silence(runtime->format, runtime->dma_area,
-					   runtime->buffer_size * runtime->channels);
+		if (!cable_shared(cable))
+			snd_pcm_format_set_silence(runtime->format,
+						   runtime->dma_area,
+						   runtime->buffer_size *
+						   runtime->channels);
 	}
 
 	dpcm->irq_pos = 0;
+	dpcm->shared_pos = 0;
+	dpcm->shared_lag = 0;
+	dpcm->hr_period_pos = 0;
 	dpcm->period_update_pending = 0;
 	dpcm->pcm_bps = bps;
 	dpcm->pcm_salign = salign;
@@ -505,6 +571,8 @@ static void clear_capture_buf(struct loopback_pcm *dpcm, unsigned int bytes)
 
 	if (dpcm->silent_size >= dpcm->pcm_buffer_size)
 		return;
+	if (cable_shared(dpcm->cable))
+		return;
 	if (dpcm->silent_size + bytes > dpcm->pcm_buffer_size)
 		bytes = dpcm->pcm_buffer_size - dpcm->silent_size;
 
@@ -523,16 +591,11 @@ static void clear_capture_buf(struct loopback_pcm *dpcm, unsigned int bytes)
 	}
 }
 
-static void copy_play_buf(struct loopback_pcm *play,
-			  struct loopback_pcm *capt,
-			  unsigned int bytes)
+/* return how many of the next bytes from the playback buffer are valid */
+static unsigned int play_valid_bytes(struct loopback_pcm *play,
+				     unsigned int bytes)
 {
 	struct snd_pcm_runtime *runtime = play->substream->runtime;
-	char *src = runtime->dma_area;
-	char *dst = capt->substream->runtime->dma_area;
-	unsigned int src_off = play->buf_pos;
-	unsigned int dst_off = capt->buf_pos;
-	unsigned int clear_bytes = 0;
 
 	/* check if playback is draining, trim the capture copy size
 	 * when our pointer is at the end of playback ring buffer */
@@ -545,11 +608,29 @@ static void copy_play_buf(struct loopback_pcm *play,
 		if (appl_ptr < appl_ptr1)
 			appl_ptr1 -= runtime->buffer_size;
 		diff = (appl_ptr - appl_ptr1) * play->pcm_salign;
-		if (diff < bytes) {
-			clear_bytes = bytes - diff;
+		if (diff < bytes)
 			bytes = diff;
-		}
 	}
+	return bytes;
+}
+
+static void copy_play_buf(struct loopback_pcm *play,
+			  struct loopback_pcm *capt,
+			  unsigned int bytes)
+{
+	struct snd_pcm_runtime *runtime = play->substream->runtime;
+	char *src = runtime->dma_area;
+	char *dst = capt->substream->runtime->dma_area;
+	unsigned int src_off = play->buf_pos;
+	unsigned int dst_off = capt->buf_pos;
+	unsigned int clear_bytes;
+
+	if (cable_shared(play->cable))
+		return;
+
+	clear_bytes = bytes;
+	bytes = play_valid_bytes(play, bytes);
+	clear_bytes -= bytes;
 
 	for (;;) {
 		unsigned int size = bytes;
@@ -860,16 +941,69 @@ static void loopback_snd_timer_dpcm_info(struct loopback_pcm *dpcm,
 			    "capture" : "playback");
 }
 
+/*
+ * On a shared buffer the playback must not write over capture data that
+ * is not read yet, as the capture reads the same memory behind the
+ * playback position.  So the playback pointer is held back to the
+ * capture appl_ptr: a writer can be at most one buffer ahead of the
+ * reader, and a capture that stops reading stalls the playback instead
+ * of losing data.  The lag only grows as fast as the playback moves, to
+ * keep the pointer monotonic; capture data queued before the capture
+ * start is thus not protected.  A playback that falls behind the
+ * capture is not reported as an xrun, the capture reads stale data.
+ *
+ * call in cable->lock
+ */
+static unsigned int shared_play_pos(struct loopback_pcm *play,
+				    unsigned int pos)
+{
+	struct loopback_cable *cable = play->cable;
+	struct loopback_pcm *capt = cable->streams[SNDRV_PCM_STREAM_CAPTURE];
+	struct snd_pcm_runtime *runtime;
+	unsigned int size = play->pcm_buffer_size;
+	unsigned int appl, unread, lag;
+
+	if (!size)
+		return pos;
+	if (!cable_shared(cable) || !capt ||
+	    !(cable->running & (1 << SNDRV_PCM_STREAM_CAPTURE))) {
+		play->shared_lag = 0;
+	} else {
+		runtime = capt->substream->runtime;
+		appl = READ_ONCE(runtime->control->appl_ptr) %
+			runtime->buffer_size;
+		unread = (capt->buf_pos + size -
+			  frames_to_bytes(runtime, appl)) % size;
+		lag = play->shared_lag +
+			(pos + size - play->shared_pos) % size;
+		play->shared_lag = min(unread, lag);
+	}
+	play->shared_pos = pos;
+	return (pos + size - play->shared_lag) % size;
+}
+
 static snd_pcm_uframes_t loopback_pointer(struct snd_pcm_substream *substream)
 {
 	struct snd_pcm_runtime *runtime = substream->runtime;
 	struct loopback_pcm *dpcm = runtime->private_data;
+	bool shared = dpcm->shared &&
+		substream->stream == SNDRV_PCM_STREAM_PLAYBACK;
 	snd_pcm_uframes_t pos;
 
-	spin_lock(&dpcm->cable->lock);
-	if (dpcm->cable->ops->pos_update)
-		dpcm->cable->ops->pos_update(dpcm->cable);
-	pos = dpcm->buf_pos;
+	if (dpcm->cable->ops->pointer) {
+		pos = dpcm->cable->ops->pointer(dpcm);
+		if (!shared)
+			return pos;
+		spin_lock(&dpcm->cable->lock);
+		pos = frames_to_bytes(runtime, pos);
+	} else {
+		spin_lock(&dpcm->cable->lock);
+		if (dpcm->cable->ops->pos_update)
+			dpcm->cable->ops->pos_update(dpcm->cable);
+		pos = dpcm->buf_pos;
+	}
+	if (shared)
+		pos = shared_play_pos(dpcm, pos);
 	spin_unlock(&dpcm->cable->lock);
 	return bytes_to_frames(runtime, pos);
 }
@@ -905,6 +1039,65 @@ static void loopback_runtime_free(struct snd_pcm_runtime *runtime)
 	kfree(dpcm);
 }
 
+/* point the runtime back to its own managed buffer */
+static void loopback_own_buffer(struct snd_pcm_runtime *runtime)
+{
+	if (runtime->dma_buffer_p)
+		runtime->dma_area = runtime->dma_buffer_p->area;
+}
+
+/* call in loopback->cable_lock */
+static void loopback_shared_release(struct loopback_pcm *dpcm)
+{
+	struct loopback_cable *cable = dpcm->cable;
+
+	if (!dpcm->shared)
+		return;
+	dpcm->shared = 0;
+	loopback_own_buffer(dpcm->substream->runtime);
+	spin_lock_irq(&cable->lock);
+	cable->shared.users--;
+	spin_unlock_irq(&cable->lock);
+	if (!cable->shared.users) {
+		vfree(cable->shared.area);
+		cable->shared.area = NULL;
+		cable->shared.bytes = 0;
+	}
+}
+
+static int loopback_hw_params(struct snd_pcm_substream *substream,
+			      struct snd_pcm_hw_params *params)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct loopback_pcm *dpcm = runtime->private_data;
+	struct loopback_cable *cable = dpcm->cable;
+	unsigned int bytes = params_buffer_bytes(params);
+
+	if (!dpcm->loopback->shared_buffer)
+		return 0;
+
+	mutex_lock(&dpcm->loopback->cable_lock);
+	loopback_shared_release(dpcm);
+	/* the PCM core clears the whole pages of the buffer */
+	if (!cable->shared.area) {
+		cable->shared.area = vzalloc(PAGE_ALIGN(bytes));
+		if (cable->shared.area)
+			cable->shared.bytes = bytes;
+	}
+	/* otherwise this side keeps its own buffer and copies */
+	if (cable->shared.area && cable->shared.bytes == bytes) {
+		runtime->dma_area = cable->shared.area;
+		dpcm->shared = 1;
+		spin_lock_irq(&cable->lock);
+		cable->shared.users++;
+		spin_unlock_irq(&cable->lock);
+	} else {
+		loopback_own_buffer(runtime);
+	}
+	mutex_unlock(&dpcm->loopback->cable_lock);
+	return 0;
+}
+
 static int loopback_hw_free(struct snd_pcm_substream *substream)
 {
 	struct snd_pcm_runtime *runtime = substream->runtime;
@@ -913,6 +1106,7 @@ static int loopback_hw_free(struct snd_pcm_substream *substream)
 
 	mutex_lock(&dpcm->loopback->cable_lock);
 	cable->valid &= ~(1 << substream->stream);
+	loopback_shared_release(dpcm);
 	mutex_unlock(&dpcm->loopback->cable_lock);
 	return 0;
 }
@@ -989,6 +1183,27 @@ static int rule_period_bytes(struct snd_pcm_hw_params *params,
 	return snd_interval_refine(hw_param_interval(params, rule->var), &t);
 }
 
+static int rule_buffer_bytes(struct snd_pcm_hw_params *params,
+			     struct snd_pcm_hw_rule *rule)
+{
+	struct loopback_pcm *dpcm = rule->private;
+	struct loopback_cable *cable = dpcm->cable;
+	struct snd_interval t;
+
+	mutex_lock(&dpcm->loopback->cable_lock);
+	if (!cable->shared.users || dpcm->shared) {
+		mutex_unlock(&dpcm->loopback->cable_lock);
+		return 0;
+	}
+	t.min = cable->shared.bytes;
+	t.max = cable->shared.bytes;
+	mutex_unlock(&dpcm->loopback->cable_lock);
+	t.openmin = 0;
+	t.openmax = 0;
+	t.integer = 1;
+	return snd_interval_refine(hw_param_interval(params, rule->var), &t);
+}
+
 static void free_cable(struct snd_pcm_substream *substream)
 {
 	struct loopback *loopback = substream->private_data;
@@ -1010,6 +1225,7 @@ static void free_cable(struct snd_pcm_substream *substream)
 			cable->ops->close_cable(dpcm);
 		/* free the cable */
 		loopback->cables[substream->number][dev] = NULL;
+		vfree(cable->shared.area);
 		kfree(cable);
 	}
 }
@@ -1180,6 +1396,266 @@ static struct loopback_ops loopback_snd_timer_ops = {
 	.dpcm_info = loopback_snd_timer_dpcm_info,
 };
 
+/* copy between two ring buffers, both offsets wrap at the given sizes */
+static void ring_copy(char *dst, unsigned int dst_off, unsigned int dst_size,
+		      const char *src, unsigned int src_off,
+		      unsigned int src_size, unsigned int bytes)
+{
+	while (bytes) {
+		unsigned int size = bytes;
+
+		if (src_off + size > src_size)
+			size = src_size - src_off;
+		if (dst_off + size > dst_size)
+			size = dst_size - dst_off;
+		memcpy(dst + dst_off, src + src_off, size);
+		bytes -= size;
+		src_off = (src_off + size) % src_size;
+		dst_off = (dst_off + size) % dst_size;
+	}
+}
+
+/* playback side of the hrtimer mode ring; call in the PCM stream lock */
+static void loopback_ring_push(struct loopback_pcm *play, unsigned int bytes)
+{
+	struct loopback_cable *cable = play->cable;
+	unsigned int running, head, space, valid;
+
+	running = READ_ONCE(cable->running) ^ READ_ONCE(cable->pause);
+	if ((running & (1 << SNDRV_PCM_STREAM_CAPTURE)) &&
+	    !cable_shared(cable)) {
+		head = cable->ring.head;
+		space = LOOPBACK_RING_SIZE -
+			(head - smp_load_acquire(&cable->ring.tail));
+		if (bytes > space) {
+			cable->ring.overruns++;
+			valid = space - space % play->pcm_salign;
+		} else {
+			valid = bytes;
+		}
+		/* the capture side fills up with silence after a drain */
+		valid = play_valid_bytes(play, valid);
+		ring_copy(cable->ring.buf, head % LOOPBACK_RING_SIZE,
+			  LOOPBACK_RING_SIZE,
+			  play->substream->runtime->dma_area, play->buf_pos,
+			  play->pcm_buffer_size, valid);
+		/* publish the data only after it has been copied */
+		smp_store_release(&cable->ring.head, head + valid);
+	}
+	bytepos_finish(play, bytes);
+}
+
+/* capture side of the hrtimer mode ring; call in the PCM stream lock */
+static void loopback_ring_pull(struct loopback_pcm *capt, unsigned int bytes)
+{
+	struct loopback_cable *cable = capt->cable;
+	unsigned int tail = cable->ring.tail;
+	unsigned int avail;
+
+	if (cable_shared(cable)) {
+		bytepos_finish(capt, bytes);
+		return;
+	}
+
+	avail = smp_load_acquire(&cable->ring.head) - tail;
+	if (avail > bytes)
+		avail = bytes;
+	if (avail) {
+		ring_copy(capt->substream->runtime->dma_area, capt->buf_pos,
+			  capt->pcm_buffer_size, cable->ring.buf,
+			  tail % LOOPBACK_RING_SIZE, LOOPBACK_RING_SIZE, avail);
+		/* release the ring space only after it has been read */
+		smp_store_release(&cable->ring.tail, tail + avail);
+		capt->silent_size = 0;
+		bytepos_finish(capt, avail);
+		bytes -= avail;
+	}
+	if (bytes) {
+		clear_capture_buf(capt, bytes);
+		bytepos_finish(capt, bytes);
+	}
+}
+
+/* time until the next period boundary */
+static ktime_t loopback_hrtimer_interval(struct loopback_pcm *dpcm)
+{
+	unsigned int frames;
+
+	frames = DIV_ROUND_UP(dpcm->pcm_period_size - dpcm->hr_period_pos,
+			      dpcm->pcm_salign);
+	return ns_to_ktime(div_u64((u64)frames * NSEC_PER_SEC * 1000 +
+				   dpcm->hr_rate - 1, dpcm->hr_rate));
+}
+
+/* call in the PCM stream lock */
+static void loopback_hrtimer_set_rate(struct loopback_pcm *dpcm, ktime_t now)
+{
+	dpcm->pcm_rate_shift = get_rate_shift(dpcm);
+	dpcm->hr_rate = div_u64((u64)dpcm->substream->runtime->rate *
+				1000 * NO_PITCH, dpcm->pcm_rate_shift);
+	dpcm->hr_base = now;
+	dpcm->hr_frames = 0;
+}
+
+/* advance the position to the current time and move the data through
+ * the ring; call in the PCM stream lock
+ */
+static void loopback_hrtimer_update(struct loopback_pcm *dpcm)
+{
+	ktime_t now = hrtimer_cb_get_time(&dpcm->hrtimer);
+	u64 frames, delta;
+	unsigned int bytes;
+
+	frames = mul_u64_u32_div(ktime_to_ns(ktime_sub(now, dpcm->hr_base)),
+				 dpcm->hr_rate, NSEC_PER_SEC);
+	frames = div_u64(frames, 1000);
+	delta = frames - dpcm->hr_frames;
+	dpcm->hr_frames = frames;
+	if (get_rate_shift(dpcm) != dpcm->pcm_rate_shift)
+		loopback_hrtimer_set_rate(dpcm, now);
+	if (!delta)
+		return;
+
+	/* after a stall longer than the buffer only one buffer is moved;
+	 * the PCM core reports the xrun anyway
+	 */
+	bytes = min_t(u64, delta * dpcm->pcm_salign, dpcm->pcm_buffer_size);
+	if (dpcm->substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+		loopback_ring_push(dpcm, bytes);
+	else
+		loopback_ring_pull(dpcm, bytes);
+
+	dpcm->hr_period_pos += bytes;
+	if (dpcm->hr_period_pos >= dpcm->pcm_period_size) {
+		dpcm->hr_period_pos %= dpcm->pcm_period_size;
+		dpcm->period_update_pending = 1;
+	}
+}
+
+static enum hrtimer_restart loopback_hrtimer_function(struct hrtimer *timer)
+{
+	struct loopback_pcm *dpcm = container_of(timer, struct loopback_pcm,
+						 hrtimer);
+	struct snd_pcm_substream *substream = dpcm->substream;
+	unsigned long flags;
+	bool elapsed;
+	ktime_t interval;
+
+	if (!atomic_read(&dpcm->hr_running))
+		return HRTIMER_NORESTART;
+
+	snd_pcm_stream_lock_irqsave(substream, flags);
+	loopback_hrtimer_update(dpcm);
+	elapsed = dpcm->period_update_pending;
+	dpcm->period_update_pending = 0;
+	interval = loopback_hrtimer_interval(dpcm);
+	snd_pcm_stream_unlock_irqrestore(substream, flags);
+
+	if (elapsed)
+		snd_pcm_period_elapsed(substream);
+	if (!atomic_read(&dpcm->hr_running))
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, interval);
+	return HRTIMER_RESTART;
+}
+
+/* call in cable->lock */
+static int loopback_hrtimer_start(struct loopback_pcm *dpcm)
+{
+	struct loopback_cable *cable = dpcm->cable;
+
+	loopback_hrtimer_set_rate(dpcm, hrtimer_cb_get_time(&dpcm->hrtimer));
+	/* drop what the playback has queued while the capture was stopped */
+	if (dpcm->substream->stream == SNDRV_PCM_STREAM_CAPTURE)
+		smp_store_release(&cable->ring.tail,
+				  READ_ONCE(cable->ring.head));
+	atomic_set(&dpcm->hr_running, 1);
+	hrtimer_start(&dpcm->hrtimer, loopback_hrtimer_interval(dpcm),
+		      HRTIMER_MODE_REL_SOFT);
+	return 0;
+}
+
+/* call in cable->lock */
+static int loopback_hrtimer_stop(struct loopback_pcm *dpcm)
+{
+	atomic_set(&dpcm->hr_running, 0);
+	/* a running callback waits for our stream lock, so don't wait for
+	 * it; it sees hr_running cleared and does not restart the timer
+	 */
+	hrtimer_try_to_cancel(&dpcm->hrtimer);
+	return 0;
+}
+
+static int loopback_hrtimer_stop_sync(struct loopback_pcm *dpcm)
+{
+	hrtimer_cancel(&dpcm->hrtimer);
+	return 0;
+}
+
+static snd_pcm_uframes_t loopback_hrtimer_pointer(struct loopback_pcm *dpcm)
+{
+	if (atomic_read(&dpcm->hr_running))
+		loopback_hrtimer_update(dpcm);
+	return bytes_to_frames(dpcm->substream->runtime, dpcm->buf_pos);
+}
+
+/* call in loopback->cable_lock */
+static int loopback_hrtimer_open(struct loopback_pcm *dpcm)
+{
+	struct loopback_cable *cable = dpcm->cable;
+
+	if (!cable->ring.buf) {
+		cable->ring.buf = kvzalloc(LOOPBACK_RING_SIZE, GFP_KERNEL);
+		if (!cable->ring.buf)
+			return -ENOMEM;
+	}
+	hrtimer_init(&dpcm->hrtimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+	dpcm->hrtimer.function = loopback_hrtimer_function;
+	atomic_set(&dpcm->hr_running, 0);
+	return 0;
+}
+
+/* call in loopback->cable_lock */
+static int loopback_hrtimer_close_cable(struct loopback_pcm *dpcm)
+{
+	struct loopback_cable *cable = dpcm->cable;
+
+	kvfree(cable->ring.buf);
+	cable->ring.buf = NULL;
+	return 0;
+}
+
+static void loopback_hrtimer_dpcm_info(struct loopback_pcm *dpcm,
+				       struct snd_info_buffer *buffer)
+{
+	struct loopback_cable *cable = dpcm->cable;
+
+	snd_iprintf(buffer, "    update_pending:\t%u\n",
+		    dpcm->period_update_pending);
+	snd_iprintf(buffer, "    period_pos:\t\t%u\n", dpcm->hr_period_pos);
+	snd_iprintf(buffer, "    rate_mhz:\t\t%u\n", dpcm->hr_rate);
+	snd_iprintf(buffer, "    ring_fill:\t\t%u\n",
+		    READ_ONCE(cable->ring.head) - READ_ONCE(cable->ring.tail));
+	snd_iprintf(buffer, "    ring_overruns:\t%u\n",
+		    READ_ONCE(cable->ring.overruns));
+}
+
+/* the cable->lock is taken only for the trigger; the position updates of
+ * both sides run in their own PCM stream lock and exchange the data over
+ * the ring
+ */
+static struct loopback_ops loopback_hrtimer_ops = {
+	.open = loopback_hrtimer_open,
+	.start = loopback_hrtimer_start,
+	.stop = loopback_hrtimer_stop,
+	.stop_sync = loopback_hrtimer_stop_sync,
+	.close_substream = loopback_hrtimer_stop_sync,
+	.close_cable = loopback_hrtimer_close_cable,
+	.pointer = loopback_hrtimer_pointer,
+	.dpcm_info = loopback_hrtimer_dpcm_info,
+};
+
 static int loopback_open(struct snd_pcm_substream *substream)
 {
 	struct snd_pcm_runtime *runtime = substream->runtime;
@@ -1207,7 +1683,10 @@ static int loopback_open(struct snd_pcm_substream *substream)
 		}
 		spin_lock_init(&cable->lock);
 		cable->hw = loopback_pcm_hardware;
-		if (loopback->timer_source)
+		if (loopback->timer_source &&
+		    !strcmp(loopback->timer_source, HRTIMER_SOURCE))
+			cable->ops = &loopback_hrtimer_ops;
+		else if (loopback->timer_source)
 			cable->ops = &loopback_snd_timer_ops;
 		else
 			cable->ops = &loopback_jiffies_timer_ops;
@@ -1259,6 +1738,16 @@ static int loopback_open(struct snd_pcm_substream *substream)
 			goto unlock;
 	}
 
+	/* A shared buffer has to be of the same size on both devices */
+	if (loopback->shared_buffer) {
+		err = snd_pcm_hw_rule_add(runtime, 0,
+					  SNDRV_PCM_HW_PARAM_BUFFER_BYTES,
+					  rule_buffer_bytes, dpcm,
+					  SNDRV_PCM_HW_PARAM_BUFFER_BYTES, -1);
+		if (err < 0)
+			goto unlock;
+	}
+
 	/* loopback_runtime_free() has not to be called if kfree(dpcm) was
 	 * already called here. Otherwise it will end up with a double free.
 	 */
@@ -1298,6 +1787,7 @@ static int loopback_close(struct snd_pcm_substream *substream)
 static const struct snd_pcm_ops loopback_pcm_ops = {
 	.open =		loopback_open,
 	.close =	loopback_close,
+	.hw_params =	loopback_hw_params,
 	.hw_free =	loopback_hw_free,
 	.prepare =	loopback_prepare,
 	.trigger =	loopback_trigger,
@@ -1618,6 +2108,7 @@ static void print_dpcm_info(struct snd_info_buffer *buffer,
 	snd_iprintf(buffer, "    bytes_per_sec:\t%u\n", dpcm->pcm_bps);
 	snd_iprintf(buffer, "    sample_align:\t%u\n", dpcm->pcm_salign);
 	snd_iprintf(buffer, "    rate_shift:\t\t%u\n", dpcm->pcm_rate_shift);
+	snd_iprintf(buffer, "    shared:\t\t%u\n", dpcm->shared);
 	if (dpcm->cable->ops->dpcm_info)
 		dpcm->cable->ops->dpcm_info(dpcm, buffer);
 }
@@ -1726,6 +2217,7 @@ static int loopback_probe(struct platform_device *devptr)
 	
 	loopback->card = card;
 	loopback_set_timer_source(loopback, timer_source[dev]);
+	loopback->shared_buffer = shared_buffer[dev];
 
 	mutex_init(&loopback->cable_lock);
 
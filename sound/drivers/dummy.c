@@ -18,6 +18,7 @@
 #include <sound/control.h>
 #include <sound/tlv.h>
 #include <sound/pcm.h>
+#include <sound/pcm_mix.h>
 #include <sound/rawmidi.h>
 #include <sound/info.h>
 #include <sound/initval.h>
@@ -50,6 +51,7 @@ static bool enable[SNDRV_CARDS] = {1, [1 ... (SNDRV_CARDS - 1)] = 0};
 static char *model[SNDRV_CARDS] = {[0 ... (SNDRV_CARDS - 1)] = NULL};
 static int pcm_devs[SNDRV_CARDS] = {[0 ... (SNDRV_CARDS - 1)] = 1};
 static int pcm_substreams[SNDRV_CARDS] = {[0 ... (SNDRV_CARDS - 1)] = 8};
+static int mix_voices[SNDRV_CARDS];
 //static int midi_devs[SNDRV_CARDS] = {[0 ... (SNDRV_CARDS - 1)] = 2};
 #ifdef CONFIG_HIGH_RES_TIMERS
 static bool hrtimer = 1;
@@ -68,6 +70,8 @@ module_param_array(pcm_devs, int, NULL, 0444);
 MODULE_PARM_DESC(pcm_devs, "PCM devices # (0-4) for dummy driver.");
 module_param_array(pcm_substreams, int, NULL, 0444);
 MODULE_PARM_DESC(pcm_substreams, "PCM substreams # (1-128) for dummy driver.");
+module_param_array(mix_voices, int, NULL, 0444);
+MODULE_PARM_DESC(mix_voices, "Mixed playback substreams # (0-128) on an extra PCM device (0 = disabled).");
 //module_param_array(midi_devs, int, NULL, 0444);
 //MODULE_PARM_DESC(midi_devs, "MIDI devices # (0-2) for dummy driver.");
 module_param(fake_buffer, bool, 0444);
@@ -696,6 +700,40 @@ static int snd_card_dummy_pcm(struct snd_dummy *dummy, int device,
 	return 0;
 }
 
+/* a device whose playback voices are mixed into one dummy substream */
+static int snd_card_dummy_pcm_mix(struct snd_dummy *dummy, int device,
+				  int voices)
+{
+	static const struct snd_pcm_mix_config config = {
+		.format = SNDRV_PCM_FORMAT_S16_LE,
+		.rate = 48000,
+		.channels = 2,
+		.period_size = 256,
+		.periods = 4,
+	};
+	struct snd_pcm *pcm, *hw_pcm;
+	int err;
+
+	err = snd_pcm_mix_new(dummy->card, "Dummy Mix", device, voices,
+			      &config, &pcm, &hw_pcm);
+	if (err < 0)
+		return err;
+	if (fake_buffer)
+		snd_pcm_set_ops(hw_pcm, SNDRV_PCM_STREAM_PLAYBACK,
+				&dummy_pcm_ops_no_buf);
+	else
+		snd_pcm_set_ops(hw_pcm, SNDRV_PCM_STREAM_PLAYBACK,
+				&dummy_pcm_ops);
+	hw_pcm->private_data = dummy;
+	if (!fake_buffer) {
+		snd_pcm_set_managed_buffer_all(hw_pcm,
+			SNDRV_DMA_TYPE_CONTINUOUS,
+			NULL,
+			0, 64*1024);
+	}
+	return 0;
+}
+
 /*
  * mixer interface
  */
@@ -1050,6 +1088,13 @@ static int snd_dummy_probe(struct platform_device *devptr)
 		if (err < 0)
 			goto __nodev;
 	}
+	if (mix_voices[dev] > 0) {
+		if (mix_voices[dev] > MAX_PCM_SUBSTREAMS)
+			mix_voices[dev] = MAX_PCM_SUBSTREAMS;
+		err = snd_card_dummy_pcm_mix(dummy, idx, mix_voices[dev]);
+		if (err < 0)
+			goto __nodev;
+	}
 
 	dummy->pcm_hw = dummy_pcm_hardware;
 	if (m) {
@@ -400,10 +400,13 @@ static void soc_free_pcm_runtime(struct snd_soc_pcm_runtime *rtd)
 		return;
 
 	list_del(&rtd->list);
+	/* dpcm_get_be() may no longer find this BE */
+	atomic_inc(&rtd->card->route_gen);
 
 	if (delayed_work_pending(&rtd->delayed_work))
 		flush_delayed_work(&rtd->delayed_work);
 	snd_soc_pcm_component_free(rtd);
+	dpcm_path_cache_free(rtd);
 
 	/*
 	 * we don't need to call kfree() for rtd->dev
@@ -500,6 +503,8 @@ static struct snd_soc_pcm_runtime *soc_new_pcm_runtime(
 
 	/* see for_each_card_rtds */
 	list_add_tail(&rtd->list, &card->rtd_list);
+	/* dpcm_get_be() may find a new BE */
+	atomic_inc(&card->route_gen);
 
 	ret = device_add_groups(dev, soc_dev_attr_groups);
 	if (ret < 0)
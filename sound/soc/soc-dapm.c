@@ -194,6 +194,18 @@ static void dapm_mark_dirty(struct snd_soc_dapm_widget *w, const char *reason)
 	}
 }
 
+/*
+ * dapm_route_changed() - Note that the set of widgets reachable from a DAI
+ *  may have changed
+ * @card: The card whose routing changed
+ *
+ * Invalidates the DPCM path walks and BE merges cached by soc-pcm.
+ */
+static void dapm_route_changed(struct snd_soc_card *card)
+{
+	atomic_inc(&card->route_gen);
+}
+
 /*
  * Common implementation for dapm_widget_invalidate_input_paths() and
  * dapm_widget_invalidate_output_paths(). The function is inlined since the
@@ -284,6 +296,8 @@ static void dapm_path_invalidate(struct snd_soc_dapm_path *p)
 	if (p->weak || p->is_supply)
 		return;
 
+	dapm_route_changed(p->source->dapm->card);
+
 	/*
 	 * The number of connected endpoints is the sum of the number of
 	 * connected endpoints of all neighbors. If a node with 0 connected
@@ -302,6 +316,8 @@ void dapm_mark_endpoints_dirty(struct snd_soc_card *card)
 
 	mutex_lock(&card->dapm_mutex);
 
+	dapm_route_changed(card);
+
 	for_each_card_widgets(card, w) {
 		if (w->is_ep) {
 			dapm_mark_dirty(w, "Rechecking endpoints");
@@ -646,6 +662,162 @@ static void soc_dapm_async_complete(struct snd_soc_dapm_context *dapm)
 		snd_soc_component_async_complete(dapm->component);
 }
 
+/*
+ * Register updates of one power sequence step, gathered so that they can be
+ * written with as few bus transactions as the regmap allows.
+ */
+#define DAPM_BURST_MAX	16
+
+struct dapm_burst {
+	struct snd_soc_dapm_context *dapm;
+	unsigned int updates;	/* update_bits() calls replaced */
+	unsigned int num;
+	struct reg_sequence regs[DAPM_BURST_MAX];
+};
+
+static bool dapm_burst_supported(struct snd_soc_dapm_context *dapm)
+{
+	struct snd_soc_component *component = dapm->component;
+
+	/*
+	 * The pop test wants to see every single write, and a sequence
+	 * notifier expects the writes preceding it to be done.
+	 */
+	return component && component->regmap &&
+	       component->driver->dapm_burst_write &&
+	       !component->driver->seq_notifier &&
+	       !dapm->card->pop_time;
+}
+
+static void dapm_burst_pack(void *buf, size_t val_bytes, unsigned int i,
+			    unsigned int val)
+{
+	switch (val_bytes) {
+	case 1:
+		((u8 *)buf)[i] = val;
+		break;
+	case 2:
+		((u16 *)buf)[i] = val;
+		break;
+	default:
+		((u32 *)buf)[i] = val;
+		break;
+	}
+}
+
+static int dapm_burst_flush(struct dapm_burst *burst)
+{
+	struct regmap *map;
+	u32 vals[DAPM_BURST_MAX];
+	size_t val_bytes;
+	unsigned int stride, start, i;
+	int transfers = 0;
+	int ret = 0;
+
+	if (!burst->updates)
+		return 0;
+
+	map = burst->dapm->component->regmap;
+	val_bytes = regmap_get_val_bytes(map);
+	stride = regmap_get_reg_stride(map);
+
+	if (burst->num && regmap_can_raw_write(map) && val_bytes <= 4) {
+		/* one bulk write per run of adjacent registers */
+		for (start = 0; start < burst->num && !ret; start = i) {
+			dapm_burst_pack(vals, val_bytes, 0,
+					burst->regs[start].def);
+			for (i = start + 1; i < burst->num; i++) {
+				if (burst->regs[i].reg !=
+				    burst->regs[i - 1].reg + stride)
+					break;
+				dapm_burst_pack(vals, val_bytes, i - start,
+						burst->regs[i].def);
+			}
+			ret = regmap_bulk_write(map, burst->regs[start].reg,
+						vals, i - start);
+			transfers++;
+		}
+	} else if (burst->num) {
+		/* merged into one transfer if the bus can multi-write */
+		ret = regmap_multi_reg_write(map, burst->regs, burst->num);
+		transfers = 1;
+	}
+
+	trace_snd_soc_dapm_burst(burst->dapm, burst->updates, burst->num,
+				 transfers);
+
+	if (ret < 0)
+		dev_err(burst->dapm->dev, "ASoC: DAPM burst write failed: %d\n",
+			ret);
+
+	burst->updates = 0;
+	burst->num = 0;
+	return ret;
+}
+
+/* Make @burst collect the updates of @dapm, if it supports it at all */
+static bool dapm_burst_start(struct dapm_burst *burst,
+			     struct snd_soc_dapm_context *dapm)
+{
+	if (burst->dapm != dapm) {
+		if (burst->dapm)
+			dapm_burst_flush(burst);
+		burst->dapm = dapm_burst_supported(dapm) ? dapm : NULL;
+	}
+
+	return burst->dapm != NULL;
+}
+
+/*
+ * Unlike regmap_update_bits() this is no atomic read-modify-write: the
+ * value read here is written by dapm_burst_flush() at the end of the step.
+ * Only card->dapm_mutex is held in between, which the writers outside of
+ * DAPM don't take, hence the requirement on dapm_burst_write that DAPM
+ * registers have no other fields.
+ */
+static int dapm_burst_update_bits(struct dapm_burst *burst, int reg,
+				  unsigned int mask, unsigned int value)
+{
+	struct regmap *map = burst->dapm->component->regmap;
+	struct reg_sequence *seq = NULL;
+	unsigned int old, new;
+	unsigned int i;
+	int ret;
+
+	/* a register queued earlier must not be read back from the device */
+	for (i = 0; i < burst->num; i++) {
+		if (burst->regs[i].reg == reg) {
+			seq = &burst->regs[i];
+			break;
+		}
+	}
+
+	if (seq) {
+		old = seq->def;
+	} else {
+		ret = regmap_read(map, reg, &old);
+		if (ret < 0)
+			return ret;
+	}
+
+	new = (old & ~mask) | (value & mask);
+	if (new != old && !seq) {
+		if (burst->num == ARRAY_SIZE(burst->regs)) {
+			ret = dapm_burst_flush(burst);
+			if (ret < 0)
+				return ret;
+		}
+		seq = &burst->regs[burst->num++];
+		seq->reg = reg;
+		seq->delay_us = 0;
+	}
+	if (seq)
+		seq->def = new;
+	burst->updates++;
+
+	return 0;
+}
+
 static struct snd_soc_dapm_widget *
 dapm_wcache_lookup(struct snd_soc_dapm_wcache *wcache, const char *name)
 {
@@ -1576,20 +1748,46 @@ static void dapm_seq_check_event(struct snd_soc_card *card,
 	}
 }
 
-/* Apply the coalesced changes from a DAPM sequence */
+static bool dapm_seq_has_events(struct list_head *pending)
+{
+	struct snd_soc_dapm_widget *w;
+
+	list_for_each_entry(w, pending, power_list) {
+		if (w->event && (w->event_flags & (SND_SOC_DAPM_PRE_PMU |
+						   SND_SOC_DAPM_POST_PMU |
+						   SND_SOC_DAPM_PRE_PMD |
+						   SND_SOC_DAPM_POST_PMD)))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Apply the coalesced changes from a DAPM sequence.  Updates without events
+ * around them are left in @burst to be written together with the rest of
+ * the sequence step.
+ */
 static void dapm_seq_run_coalesced(struct snd_soc_card *card,
-				   struct list_head *pending)
+				   struct list_head *pending,
+				   struct dapm_burst *burst)
 {
 	struct snd_soc_dapm_context *dapm;
 	struct snd_soc_dapm_widget *w;
 	int reg;
 	unsigned int value = 0;
 	unsigned int mask = 0;
+	bool queue;
 
 	w = list_first_entry(pending, struct snd_soc_dapm_widget, power_list);
 	reg = w->reg;
 	dapm = w->dapm;
 
+	/* events have to see all writes ordered before them done */
+	queue = dapm_burst_start(burst, dapm) && !dapm_seq_has_events(pending);
+	if (!queue && burst->dapm)
+		dapm_burst_flush(burst);
+
 	list_for_each_entry(w, pending, power_list) {
 		WARN_ON(reg != w->reg || dapm != w->dapm);
 		w->power = w->new_power;
@@ -1618,7 +1816,10 @@ static void dapm_seq_run_coalesced(struct snd_soc_card *card,
 			"pop test : Applying 0x%x/0x%x to %x in %dms\n",
 			value, mask, reg, card->pop_time);
 		pop_wait(card->pop_time);
-		soc_dapm_update_bits(dapm, reg, mask, value);
+		if (queue)
+			dapm_burst_update_bits(burst, reg, mask, value);
+		else
+			soc_dapm_update_bits(dapm, reg, mask, value);
 	}
 
 	list_for_each_entry(w, pending, power_list) {
@@ -1645,6 +1846,7 @@ static void dapm_seq_run(struct snd_soc_card *card,
 	int cur_subseq = -1;
 	int cur_reg = SND_SOC_NOPM;
 	struct snd_soc_dapm_context *cur_dapm = NULL;
+	struct dapm_burst burst = { };
 	int ret, i;
 	int *sort;
 
@@ -1660,7 +1862,13 @@ static void dapm_seq_run(struct snd_soc_card *card,
 		if (sort[w->id] != cur_sort || w->reg != cur_reg ||
 		    w->dapm != cur_dapm || w->subseq != cur_subseq) {
 			if (!list_empty(&pending))
-				dapm_seq_run_coalesced(card, &pending);
+				dapm_seq_run_coalesced(card, &pending, &burst);
+
+			/* a new sequence step, write out the previous one */
+			if (burst.dapm && (sort[w->id] != cur_sort ||
+					   w->dapm != cur_dapm ||
+					   w->subseq != cur_subseq))
+				dapm_burst_flush(&burst);
 
 			if (cur_dapm && cur_dapm->component) {
 				for (i = 0; i < ARRAY_SIZE(dapm_up_seq); i++)
@@ -1723,7 +1931,9 @@ static void dapm_seq_run(struct snd_soc_card *card,
 	}
 
 	if (!list_empty(&pending))
-		dapm_seq_run_coalesced(card, &pending);
+		dapm_seq_run_coalesced(card, &pending, &burst);
+	if (burst.dapm)
+		dapm_burst_flush(&burst);
 
 	if (cur_dapm && cur_dapm->component) {
 		for (i = 0; i < ARRAY_SIZE(dapm_up_seq); i++)
@@ -1742,6 +1952,7 @@ static void dapm_widget_update(struct snd_soc_card *card)
 	struct snd_soc_dapm_update *update = card->update;
 	struct snd_soc_dapm_widget_list *wlist;
 	struct snd_soc_dapm_widget *w = NULL;
+	struct dapm_burst burst = { };
 	unsigned int wi;
 	int ret;
 
@@ -1762,6 +1973,23 @@ static void dapm_widget_update(struct snd_soc_card *card)
 	if (!w)
 		return;
 
+	/* both registers of a double update may go out in one transfer */
+	if (dapm_burst_start(&burst, w->dapm)) {
+		ret = dapm_burst_update_bits(&burst, update->reg, update->mask,
+					     update->val);
+		if (!ret && update->has_second_set)
+			ret = dapm_burst_update_bits(&burst, update->reg2,
+						     update->mask2,
+						     update->val2);
+		if (!ret)
+			ret = dapm_burst_flush(&burst);
+		if (ret < 0)
+			dev_err(w->dapm->dev,
+				"ASoC: %s DAPM update failed: %d\n",
+				w->name, ret);
+		goto post_reg;
+	}
+
 	ret = soc_dapm_update_bits(w->dapm, update->reg, update->mask,
 		update->val);
 	if (ret < 0)
@@ -1777,6 +2005,7 @@ static void dapm_widget_update(struct snd_soc_card *card)
 				w->name, ret);
 	}
 
+post_reg:
 	for_each_dapm_widgets(wlist, wi, w) {
 		if (w->event && (w->event_flags & SND_SOC_DAPM_POST_REG)) {
 			ret = w->event(w, update->kcontrol, SND_SOC_DAPM_POST_REG);
@@ -2473,6 +2702,8 @@ struct attribute *soc_dapm_dev_attrs[] = {
 
 static void dapm_free_path(struct snd_soc_dapm_path *path)
 {
+	dapm_route_changed(path->source->dapm->card);
+
 	list_del(&path->list_node[SND_SOC_DAPM_DIR_IN]);
 	list_del(&path->list_node[SND_SOC_DAPM_DIR_OUT]);
 	list_del(&path->list_kcontrol);
@@ -2560,6 +2791,7 @@ static int snd_soc_dapm_set_pin(struct snd_soc_dapm_context *dapm,
 		dapm_mark_dirty(w, "pin configuration");
 		dapm_widget_invalidate_input_paths(w);
 		dapm_widget_invalidate_output_paths(w);
+		dapm_route_changed(dapm->card);
 	}
 
 	w->connected = status;
@@ -4562,6 +4794,7 @@ int snd_soc_dapm_force_enable_pin_unlocked(struct snd_soc_dapm_context *dapm,
 		 */
 		dapm_widget_invalidate_input_paths(w);
 		dapm_widget_invalidate_output_paths(w);
+		dapm_route_changed(dapm->card);
 		w->connected = 1;
 	}
 	w->force = 1;
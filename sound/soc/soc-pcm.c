@@ -1270,6 +1270,51 @@ static bool dpcm_end_walk_at_be(struct snd_soc_dapm_widget *widget,
 	return false;
 }
 
+static size_t dpcm_path_size(struct snd_soc_dapm_widget_list *list)
+{
+	return struct_size(list, widgets, list->num_widgets);
+}
+
+/*
+ * The DAPM walk only depends on the routing, so the last result is kept per
+ * FE stream and handed out again until card->route_gen moves on.
+ */
+static bool dpcm_path_cache_get(struct snd_soc_pcm_runtime *fe, int stream,
+				struct snd_soc_dapm_widget_list **list)
+{
+	struct snd_soc_dpcm_runtime *dpcm = &fe->dpcm[stream];
+
+	if (!dpcm->path_cache || dpcm->path_cache_gen != dpcm->route_gen)
+		return false;
+
+	*list = kmemdup(dpcm->path_cache, dpcm_path_size(dpcm->path_cache),
+			GFP_KERNEL);
+	return *list != NULL;
+}
+
+static void dpcm_path_cache_put(struct snd_soc_pcm_runtime *fe, int stream,
+				struct snd_soc_dapm_widget_list *list,
+				int paths)
+{
+	struct snd_soc_dpcm_runtime *dpcm = &fe->dpcm[stream];
+
+	kfree(dpcm->path_cache);
+	dpcm->path_cache = kmemdup(list, dpcm_path_size(list), GFP_KERNEL);
+	dpcm->path_cache_paths = paths;
+	dpcm->path_cache_gen = dpcm->route_gen;
+}
+
+void dpcm_path_cache_free(struct snd_soc_pcm_runtime *fe)
+{
+	int stream;
+
+	for_each_pcm_streams(stream) {
+		kfree(fe->dpcm[stream].path_cache);
+		fe->dpcm[stream].path_cache = NULL;
+		fe->dpcm[stream].hw_cache_valid = false;
+	}
+}
+
 int dpcm_path_get(struct snd_soc_pcm_runtime *fe,
 	int stream, struct snd_soc_dapm_widget_list **list)
 {
@@ -1282,9 +1327,21 @@ int dpcm_path_get(struct snd_soc_pcm_runtime *fe,
 		return -EINVAL;
 	}
 
+	/* sampled before the walk, so that a concurrent change drops it */
+	fe->dpcm[stream].route_gen = atomic_read(&fe->card->route_gen);
+
+	if (dpcm_path_cache_get(fe, stream, list)) {
+		paths = fe->dpcm[stream].path_cache_paths;
+		dev_dbg(fe->dev, "ASoC: reusing %d audio %s paths\n", paths,
+			stream ? "capture" : "playback");
+		return paths;
+	}
+
 	/* get number of valid DAI paths and their widgets */
 	paths = snd_soc_dapm_dai_get_connected_widgets(cpu_dai, stream, list,
 			dpcm_end_walk_at_be);
+	if (paths >= 0)
+		dpcm_path_cache_put(fe, stream, *list, paths);
 
 	dev_dbg(fe->dev, "ASoC: found %d audio %s paths\n", paths,
 			stream ? "capture" : "playback");
@@ -1682,10 +1739,34 @@ static void dpcm_runtime_merge_rate(struct snd_pcm_substream *substream,
 	}
 }
 
+static void dpcm_hw_save(struct snd_soc_dpcm_hw *hw,
+			 struct snd_pcm_hardware *pcm_hw)
+{
+	hw->formats = pcm_hw->formats;
+	hw->rates = pcm_hw->rates;
+	hw->rate_min = pcm_hw->rate_min;
+	hw->rate_max = pcm_hw->rate_max;
+	hw->channels_min = pcm_hw->channels_min;
+	hw->channels_max = pcm_hw->channels_max;
+}
+
+static void dpcm_hw_restore(struct snd_pcm_hardware *pcm_hw,
+			    struct snd_soc_dpcm_hw *hw)
+{
+	pcm_hw->formats = hw->formats;
+	pcm_hw->rates = hw->rates;
+	pcm_hw->rate_min = hw->rate_min;
+	pcm_hw->rate_max = hw->rate_max;
+	pcm_hw->channels_min = hw->channels_min;
+	pcm_hw->channels_max = hw->channels_max;
+}
+
 static void dpcm_set_fe_runtime(struct snd_pcm_substream *substream)
 {
 	struct snd_pcm_runtime *runtime = substream->runtime;
 	struct snd_soc_pcm_runtime *rtd = asoc_substream_to_rtd(substream);
+	struct snd_soc_dpcm_runtime *dpcm = &rtd->dpcm[substream->stream];
+	struct snd_soc_dpcm_hw in;
 	struct snd_soc_dai *cpu_dai;
 	int i;
 
@@ -1702,11 +1783,29 @@ static void dpcm_set_fe_runtime(struct snd_pcm_substream *substream)
 						   substream->stream));
 	}
 
+	/*
+	 * The connected BEs follow from the path walk, so the merge can be
+	 * reused as long as the routing and the FE limits are unchanged.
+	 */
+	dpcm_hw_save(&in, &runtime->hw);
+	if (dpcm->hw_cache_valid &&
+	    dpcm->hw_cache_gen == dpcm->route_gen &&
+	    dpcm->route_gen == atomic_read(&rtd->card->route_gen) &&
+	    !memcmp(&in, &dpcm->hw_cache_in, sizeof(in))) {
+		dpcm_hw_restore(&runtime->hw, &dpcm->hw_cache_out);
+		return;
+	}
+
 	dpcm_runtime_merge_format(substream, &runtime->hw.formats);
 	dpcm_runtime_merge_chan(substream, &runtime->hw.channels_min,
 				&runtime->hw.channels_max);
 	dpcm_runtime_merge_rate(substream, &runtime->hw.rates,
 				&runtime->hw.rate_min, &runtime->hw.rate_max);
+
+	dpcm->hw_cache_in = in;
+	dpcm_hw_save(&dpcm->hw_cache_out, &runtime->hw);
+	dpcm->hw_cache_gen = dpcm->route_gen;
+	dpcm->hw_cache_valid = true;
 }
 
 static int dpcm_fe_dai_do_trigger(struct snd_pcm_substream *substream, int cmd);
@@ -76,6 +76,8 @@ static char *delayed_register[SNDRV_CARDS];
 
 bool snd_usb_use_vmalloc = true;
 bool snd_usb_skip_validation;
+bool snd_usb_zero_copy;
+bool snd_usb_lowlatency;
 
 module_param_array(index, int, NULL, 0444);
 MODULE_PARM_DESC(index, "Index value for the USB audio adapter.");
@@ -102,6 +104,10 @@ module_param_named(use_vmalloc, snd_usb_use_vmalloc, bool, 0444);
 MODULE_PARM_DESC(use_vmalloc, "Use vmalloc for PCM intermediate buffers (default: yes).");
 module_param_named(skip_validation, snd_usb_skip_validation, bool, 0444);
 MODULE_PARM_DESC(skip_validation, "Skip unit descriptor validation (default: no).");
+module_param_named(zero_copy, snd_usb_zero_copy, bool, 0444);
+MODULE_PARM_DESC(zero_copy, "Let playback URBs transfer directly from the PCM buffer when possible (default: no).");
+module_param_named(lowlatency, snd_usb_lowlatency, bool, 0644);
+MODULE_PARM_DESC(lowlatency, "Size playback URBs and their queue after the period instead of the buffer (default: no).");
 
 /*
  * we keep the snd_usb_audio_t instances by ourselves for merging
@@ -43,6 +43,9 @@ struct snd_usb_power_domain;
 struct snd_urb_ctx {
 	struct urb *urb;
 	unsigned int buffer_size;	/* size of data buffer, if data URB */
+	void *buffer;			/* own data buffer, if data URB */
+	dma_addr_t buffer_dma;		/* DMA address of own data buffer */
+	bool ring_mapped;		/* transfers from the PCM buffer instead */
 	struct snd_usb_substream *subs;
 	struct snd_usb_endpoint *ep;
 	int index;	/* index for urb array */
@@ -144,6 +147,10 @@ struct snd_usb_substream {
 	unsigned int hwptr_done;	/* processed byte position in the buffer */
 	unsigned int transfer_done;		/* processed frames since last period update */
 	unsigned int frame_limit;	/* limits number of packets in URB */
+	unsigned int fixed_packet_frames;	/* packet size for the playback fast path, 0 = off */
+	bool zero_copy;			/* URBs transfer from the PCM buffer */
+	unsigned int zc_queued;		/* bytes of the PCM buffer held by URBs */
+	unsigned int zc_retired;	/* retired frames since last period update */
 
 	/* data and sync endpoints for this stream */
 	unsigned int ep_num;		/* the endpoint number */
@@ -75,8 +75,7 @@ static void release_urb_ctx(struct snd_urb_ctx *u)
 {
 	if (u->buffer_size)
 		usb_free_coherent(u->ep->chip->dev, u->buffer_size,
-				  u->urb->transfer_buffer,
-				  u->urb->transfer_dma);
+				  u->buffer, u->buffer_dma);
 	usb_free_urb(u->urb);
 	u->urb = NULL;
 }
@@ -249,6 +248,12 @@ static void prepare_outbound_urb(struct snd_usb_endpoint *ep,
 
 	switch (ep->type) {
 	case SND_USB_ENDPOINT_TYPE_DATA:
+		/* a zero-copy URB may have been pointed at the PCM buffer */
+		if (ctx->ring_mapped) {
+			urb->transfer_buffer = ctx->buffer;
+			urb->transfer_dma = ctx->buffer_dma;
+			ctx->ring_mapped = false;
+		}
 		if (ep->prepare_data_urb) {
 			ep->prepare_data_urb(ep->data_subs, urb);
 		} else {
@@ -619,6 +624,18 @@ static void release_urbs(struct snd_usb_endpoint *ep, int force)
 	ep->nurbs = 0;
 }
 
+/*
+ * In low-latency mode URBs cover at most 1ms, so that the completion
+ * granularity follows small periods, and a playback endpoint queues no
+ * more of them than two periods need instead of filling the buffer up to
+ * MAX_QUEUE.  At least two URBs stay in flight for double buffering.
+ */
+static unsigned int lowlatency_max_urbs(unsigned int urbs_per_period,
+					unsigned int periods_per_buffer)
+{
+	return max(2u, urbs_per_period * min(2u, periods_per_buffer));
+}
+
 /*
  * Check data endpoint for format differences
  */
@@ -715,6 +732,9 @@ static bool check_ep_params(struct snd_usb_endpoint *ep,
 		max_packs_per_urb = min(max_packs_per_urb,
 					1U << sync_ep->syncinterval);
 	max_packs_per_urb = max(1u, max_packs_per_urb >> ep->datainterval);
+	if (snd_usb_lowlatency)
+		max_packs_per_urb = min(max_packs_per_urb,
+					max(1u, packs_per_ms));
 
 	/*
 	 * Capture endpoints need to use small URBs because there's no way
@@ -779,6 +799,10 @@ static bool check_ep_params(struct snd_usb_endpoint *ep,
 		/* try to use enough URBs to contain an entire ALSA buffer */
 		max_urbs = min((unsigned) MAX_URBS,
 				MAX_QUEUE * packs_per_ms / urb_packs);
+		if (snd_usb_lowlatency)
+			max_urbs = min(max_urbs,
+				       lowlatency_max_urbs(urbs_per_period,
+							   periods_per_buffer));
 		ret = ret && (ep->nurbs == min(max_urbs,
 				urbs_per_period * periods_per_buffer));
 	}
@@ -886,6 +910,9 @@ static int data_ep_set_params(struct snd_usb_endpoint *ep,
 		max_packs_per_urb = min(max_packs_per_urb,
 					1U << sync_ep->syncinterval);
 	max_packs_per_urb = max(1u, max_packs_per_urb >> ep->datainterval);
+	if (snd_usb_lowlatency)
+		max_packs_per_urb = min(max_packs_per_urb,
+					max(1u, packs_per_ms));
 
 	/*
 	 * Capture endpoints need to use small URBs because there's no way
@@ -949,6 +976,10 @@ static int data_ep_set_params(struct snd_usb_endpoint *ep,
 		/* try to use enough URBs to contain an entire ALSA buffer */
 		max_urbs = min((unsigned) MAX_URBS,
 				MAX_QUEUE * packs_per_ms / urb_packs);
+		if (snd_usb_lowlatency)
+			max_urbs = min(max_urbs,
+				       lowlatency_max_urbs(urbs_per_period,
+							   periods_per_buffer));
 		ep->nurbs = min(max_urbs, urbs_per_period * periods_per_buffer);
 	}
 
@@ -966,11 +997,13 @@ static int data_ep_set_params(struct snd_usb_endpoint *ep,
 		if (!u->urb)
 			goto out_of_memory;
 
-		u->urb->transfer_buffer =
-			usb_alloc_coherent(ep->chip->dev, u->buffer_size,
-					   GFP_KERNEL, &u->urb->transfer_dma);
-		if (!u->urb->transfer_buffer)
+		u->buffer = usb_alloc_coherent(ep->chip->dev, u->buffer_size,
+					       GFP_KERNEL, &u->buffer_dma);
+		if (!u->buffer)
 			goto out_of_memory;
+		u->urb->transfer_buffer = u->buffer;
+		u->urb->transfer_dma = u->buffer_dma;
+		u->ring_mapped = false;
 		u->urb->pipe = ep->pipe;
 		u->urb->transfer_flags = URB_NO_TRANSFER_DMA_MAP;
 		u->urb->interval = 1 << ep->datainterval;
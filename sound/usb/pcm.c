@@ -32,11 +32,18 @@
 snd_pcm_uframes_t snd_usb_pcm_delay(struct snd_usb_substream *subs,
 				    unsigned int rate)
 {
+	struct snd_usb_endpoint *ep = subs->data_endpoint;
 	int current_frame_number;
 	int frame_diff;
 	int est_delay;
 
-	if (!subs->last_delay)
+	/*
+	 * Captured frames wait in the URB being filled until it completes.
+	 * That's only worth estimating with the short low-latency URBs.
+	 */
+	if (!subs->last_delay &&
+	    (subs->direction == SNDRV_PCM_STREAM_PLAYBACK ||
+	     !snd_usb_lowlatency || !subs->running || !ep || !ep->nurbs))
 		return 0; /* short path */
 
 	current_frame_number = usb_get_current_frame_number(subs->dev);
@@ -50,10 +57,15 @@ snd_pcm_uframes_t snd_usb_pcm_delay(struct snd_usb_substream *subs,
 	/* Approximation based on number of samples per USB frame (ms),
 	   some truncation for 44.1 but the estimate is good enough */
 	est_delay =  frame_diff * rate / 1000;
-	if (subs->direction == SNDRV_PCM_STREAM_PLAYBACK)
+	if (subs->direction == SNDRV_PCM_STREAM_PLAYBACK) {
 		est_delay = subs->last_delay - est_delay;
-	else
+	} else {
 		est_delay = subs->last_delay + est_delay;
+		/* capture delay is by construction limited to one URB */
+		if (ep && ep->nurbs)
+			est_delay = min_t(int, est_delay,
+					  ep->urb[0].packets * ep->maxframesize);
+	}
 
 	if (est_delay < 0)
 		est_delay = 0;
@@ -65,17 +77,28 @@ snd_pcm_uframes_t snd_usb_pcm_delay(struct snd_usb_substream *subs,
  */
 static snd_pcm_uframes_t snd_usb_pcm_pointer(struct snd_pcm_substream *substream)
 {
-	struct snd_usb_substream *subs = substream->runtime->private_data;
-	unsigned int hwptr_done;
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct snd_usb_substream *subs = runtime->private_data;
+	unsigned int hwptr_done, buffer_bytes;
 
 	if (atomic_read(&subs->stream->chip->shutdown))
 		return SNDRV_PCM_POS_XRUN;
 	spin_lock(&subs->lock);
 	hwptr_done = subs->hwptr_done;
-	substream->runtime->delay = snd_usb_pcm_delay(subs,
-						substream->runtime->rate);
+	if (subs->zero_copy) {
+		/* the data still held by URBs must not be overwritten yet,
+		 * so report only what the host controller has given back
+		 */
+		buffer_bytes = frames_to_bytes(runtime, runtime->buffer_size);
+		hwptr_done += buffer_bytes - subs->zc_queued;
+		if (hwptr_done >= buffer_bytes)
+			hwptr_done -= buffer_bytes;
+		runtime->delay = 0;
+	} else {
+		runtime->delay = snd_usb_pcm_delay(subs, runtime->rate);
+	}
 	spin_unlock(&subs->lock);
-	return hwptr_done / (substream->runtime->frame_bits >> 3);
+	return hwptr_done / (runtime->frame_bits >> 3);
 }
 
 /*
@@ -895,6 +918,49 @@ static int snd_usb_hw_free(struct snd_pcm_substream *substream)
 	return 0;
 }
 
+/*
+ * the number of frames per packet if all packets of a playback stream carry
+ * the same amount and no quirk or feedback handling is involved; then
+ * prepare_playback_urb() can use a precomputed layout.  Otherwise 0.
+ */
+static unsigned int fixed_packet_frames(struct snd_usb_substream *subs)
+{
+	struct snd_usb_endpoint *ep = subs->data_endpoint;
+
+	if (subs->direction != SNDRV_PCM_STREAM_PLAYBACK)
+		return 0;
+	if (ep->sync_master || ep->fill_max || ep->sample_rem)
+		return 0;
+	if (subs->tx_length_quirk || subs->fmt_type == UAC_FORMAT_TYPE_II)
+		return 0;
+	if (subs->pcm_format == SNDRV_PCM_FORMAT_DSD_U16_LE &&
+	    subs->cur_audiofmt->dsd_dop)
+		return 0;
+	if (subs->pcm_format == SNDRV_PCM_FORMAT_DSD_U8 &&
+	    subs->cur_audiofmt->dsd_bitrev)
+		return 0;
+	return ep->packsize[0];
+}
+
+/*
+ * whether the fast path may hand out the PCM buffer itself to the URBs:
+ * this needs a physically contiguous buffer mapped for the host controller,
+ * and no packet may straddle the end of the buffer.
+ */
+static bool use_zero_copy(struct snd_usb_substream *subs)
+{
+	struct snd_pcm_runtime *runtime = subs->pcm_substream->runtime;
+	unsigned int plen;
+
+	if (!snd_usb_zero_copy || !subs->fixed_packet_frames)
+		return false;
+	if (!runtime->dma_buffer_p ||
+	    runtime->dma_buffer_p->dev.type != SNDRV_DMA_TYPE_DEV)
+		return false;
+	plen = subs->fixed_packet_frames * subs->data_endpoint->stride;
+	return !(frames_to_bytes(runtime, runtime->buffer_size) % plen);
+}
+
 /*
  * prepare callback
  *
@@ -953,9 +1019,14 @@ static int snd_usb_pcm_prepare(struct snd_pcm_substream *substream)
 	subs->data_endpoint->curframesize =
 		bytes_to_frames(runtime, subs->data_endpoint->curpacksize);
 
+	subs->fixed_packet_frames = fixed_packet_frames(subs);
+	subs->zero_copy = use_zero_copy(subs);
+
 	/* reset the pointer */
 	subs->hwptr_done = 0;
 	subs->transfer_done = 0;
+	subs->zc_queued = 0;
+	subs->zc_retired = 0;
 	subs->last_delay = 0;
 	subs->last_frame_number = 0;
 	runtime->delay = 0;
@@ -1583,6 +1654,97 @@ static unsigned int copy_to_urb_quirk(struct snd_usb_substream *subs,
 	return bytes;
 }
 
+/*
+ * fast path of prepare_playback_urb() for fixed packet sizes: the number of
+ * packets up to the period boundary or the frame limit is calculated at
+ * once instead of stepping through the packets, and the whole URB is
+ * filled with a single copy (two at the ring buffer wrap-around).
+ *
+ * In zero-copy mode the URB transfers straight from the PCM buffer instead;
+ * it is then cut at the buffer end, and the period is reported only when
+ * the URB is retired, see retire_playback_urb().
+ */
+static void prepare_playback_urb_fixed(struct snd_usb_substream *subs,
+				       struct urb *urb)
+{
+	struct snd_pcm_runtime *runtime = subs->pcm_substream->runtime;
+	struct snd_usb_endpoint *ep = subs->data_endpoint;
+	struct snd_urb_ctx *ctx = urb->context;
+	unsigned int counts = subs->fixed_packet_frames;
+	unsigned int plen = counts * ep->stride;
+	unsigned int buffer_bytes = frames_to_bytes(runtime, runtime->buffer_size);
+	unsigned int packets, limit, frames, bytes, i;
+	int stride = runtime->frame_bits >> 3;
+	int period_elapsed = 0;
+	unsigned long flags;
+
+	spin_lock_irqsave(&subs->lock, flags);
+	subs->frame_limit += ep->max_urb_frames;
+
+	/* the same stop conditions as the generic loop: the first packet
+	 * reaching the period boundary or the frame limit ends the URB
+	 */
+	packets = DIV_ROUND_UP(runtime->period_size - subs->transfer_done,
+			       counts);
+	if (subs->frame_limit > subs->transfer_done) {
+		limit = DIV_ROUND_UP(subs->frame_limit - subs->transfer_done,
+				     counts);
+		packets = min(packets, limit);
+	} else {
+		packets = 1;
+	}
+	packets = min_t(unsigned int, packets, ctx->packets);
+	if (subs->zero_copy)
+		packets = min(packets, (buffer_bytes - subs->hwptr_done) / plen);
+
+	for (i = 0; i < packets; i++) {
+		urb->iso_frame_desc[i].offset = i * plen;
+		urb->iso_frame_desc[i].length = plen;
+	}
+	urb->number_of_packets = packets;
+	frames = packets * counts;
+	bytes = packets * plen;
+
+	subs->transfer_done += frames;
+	if (subs->transfer_done >= runtime->period_size) {
+		subs->transfer_done -= runtime->period_size;
+		subs->frame_limit = 0;
+		period_elapsed = 1;
+	}
+
+	if (subs->zero_copy) {
+		urb->transfer_buffer = runtime->dma_area + subs->hwptr_done;
+		urb->transfer_dma = runtime->dma_addr + subs->hwptr_done;
+		ctx->ring_mapped = true;
+		subs->zc_queued += bytes;
+		subs->hwptr_done += bytes;
+		if (subs->hwptr_done >= buffer_bytes)
+			subs->hwptr_done -= buffer_bytes;
+		period_elapsed = 0;
+	} else {
+		copy_to_urb(subs, urb, 0, stride, bytes);
+	}
+
+	/* update delay with exact number of samples queued */
+	runtime->delay = subs->last_delay;
+	runtime->delay += frames;
+	subs->last_delay = runtime->delay;
+
+	/* realign last_frame_number */
+	subs->last_frame_number = usb_get_current_frame_number(subs->dev);
+	subs->last_frame_number &= 0xFF; /* keep 8 LSBs */
+
+	if (subs->trigger_tstamp_pending_update) {
+		snd_pcm_gettime(runtime, &runtime->trigger_tstamp);
+		subs->trigger_tstamp_pending_update = false;
+	}
+
+	spin_unlock_irqrestore(&subs->lock, flags);
+	urb->transfer_buffer_length = bytes;
+	if (period_elapsed)
+		snd_pcm_period_elapsed(subs->pcm_substream);
+}
+
 static void prepare_playback_urb(struct snd_usb_substream *subs,
 				 struct urb *urb)
 {
@@ -1593,6 +1755,11 @@ static void prepare_playback_urb(struct snd_usb_substream *subs,
 	int i, stride, period_elapsed = 0;
 	unsigned long flags;
 
+	if (subs->fixed_packet_frames) {
+		prepare_playback_urb_fixed(subs, urb);
+		return;
+	}
+
 	stride = runtime->frame_bits >> 3;
 
 	frames = 0;
@@ -1704,8 +1871,9 @@ static void retire_playback_urb(struct snd_usb_substream *subs,
 	unsigned long flags;
 	struct snd_pcm_runtime *runtime = subs->pcm_substream->runtime;
 	struct snd_usb_endpoint *ep = subs->data_endpoint;
+	struct snd_urb_ctx *ctx = urb->context;
 	int processed = urb->transfer_buffer_length / ep->stride;
-	int est_delay;
+	int est_delay, period_elapsed = 0;
 
 	/* ignore the delay accounting when processed=0 is given, i.e.
 	 * silent payloads are processed before handling the actual data
@@ -1714,6 +1882,15 @@ static void retire_playback_urb(struct snd_usb_substream *subs,
 		return;
 
 	spin_lock_irqsave(&subs->lock, flags);
+	if (ctx->ring_mapped) {
+		/* the PCM buffer area of this URB can be reused now */
+		subs->zc_queued -= urb->transfer_buffer_length;
+		subs->zc_retired += processed;
+		if (subs->zc_retired >= runtime->period_size) {
+			subs->zc_retired -= runtime->period_size;
+			period_elapsed = 1;
+		}
+	}
 	if (!subs->last_delay)
 		goto out; /* short path */
 
@@ -1745,6 +1922,8 @@ static void retire_playback_urb(struct snd_usb_substream *subs,
 
  out:
 	spin_unlock_irqrestore(&subs->lock, flags);
+	if (period_elapsed)
+		snd_pcm_period_elapsed(subs->pcm_substream);
 }
 
 static int snd_usb_substream_playback_trigger(struct snd_pcm_substream *substream,
@@ -1860,7 +2039,11 @@ void snd_usb_preallocate_buffer(struct snd_usb_substream *subs)
 	struct snd_pcm_substream *s = pcm->streams[subs->direction].substream;
 	struct device *dev = subs->dev->bus->sysdev;
 
-	if (snd_usb_use_vmalloc)
+	/* zero-copy playback needs a contiguous buffer for the controller */
+	if (snd_usb_zero_copy && subs->direction == SNDRV_PCM_STREAM_PLAYBACK)
+		snd_pcm_set_managed_buffer(s, SNDRV_DMA_TYPE_DEV,
+					   dev, 64*1024, 512*1024);
+	else if (snd_usb_use_vmalloc)
 		snd_pcm_set_managed_buffer(s, SNDRV_DMA_TYPE_VMALLOC,
 					   NULL, 0, 0);
 	else
@@ -128,5 +128,7 @@ void snd_usb_unlock_shutdown(struct snd_usb_audio *chip);
 
 extern bool snd_usb_use_vmalloc;
 extern bool snd_usb_skip_validation;
+extern bool snd_usb_zero_copy;
+extern bool snd_usb_lowlatency;
 
 #endif /* __USBAUDIO_H */